@@ -0,0 +1,173 @@
+#pragma once
+#include "broadphase.hpp"
+
+// Incrementally updated bounding volume hierarchy in the style of Box2D's b2DynamicTree. Each body owns a leaf with a
+// fattened AABB; the leaf is only removed and re-inserted once the body's tight AABB leaves it, and insertion picks the
+// sibling by surface-area (perimeter) cost with tree rotations keeping that cost low. Query cost depends on
+// how many boxes actually overlap, not on how much body sizes differ.
+struct AABBTree {
+    AABBTree(float margin = 2.f, float margin_fraction = 0.1f) {this->margin = margin; this->margin_fraction = margin_fraction;}
+    static constexpr int NONE = -1;
+    struct Node {
+        AABB box;
+        int parent, child1, child2, height, body; // parent doubles as the free list link
+        bool isLeaf() const {return child1 == NONE;}
+    };
+    float margin, margin_fraction;
+    std::vector<Node> nodes;
+    std::vector<int> body_leaf, leaf_scratch;
+    std::vector<std::pair<int, int>> pair_stack;
+    int root = NONE, free_list = NONE;
+
+    void findPairs(const std::vector<AABB>& bounds, std::vector<BodyPair>& pairs) {
+        const int n = bounds.size();
+        body_leaf.resize(n, NONE);
+        for (int i = 0; i < n; i++) {
+            if (body_leaf[i] == NONE) {body_leaf[i] = createLeaf(bounds[i], i); continue;}
+            const AABB& fat = nodes[body_leaf[i]].box, & b = bounds[i];
+            if (fat.min_x <= b.min_x && fat.min_y <= b.min_y && b.max_x <= fat.max_x && b.max_y <= fat.max_y) continue;
+            removeLeaf(body_leaf[i]);
+            nodes[body_leaf[i]].box = fatten(b);
+            insertLeaf(body_leaf[i]);
+        }
+        // self-collision of the tree: the two subtrees below every internal node are tested against each other, so
+        // each overlapping pair is reached exactly once without querying every body separately
+        pairs.clear(); pair_stack.clear();
+        for (uint32_t i = 0; i < nodes.size(); i++) if (nodes[i].height > 0) pair_stack.push_back({nodes[i].child1, nodes[i].child2});
+        while (!pair_stack.empty()) {
+            const int a = pair_stack.back().first, b = pair_stack.back().second; pair_stack.pop_back();
+            const Node& na = nodes[a], & nb = nodes[b];
+            if (!na.box.overlaps(nb.box)) continue;
+            if (na.isLeaf() && nb.isLeaf()) {
+                if (bounds[na.body].overlaps(bounds[nb.body])) pairs.push_back({(uint32_t)std::min(na.body, nb.body), (uint32_t)std::max(na.body, nb.body)});
+            } else if (nb.isLeaf() || (!na.isLeaf() && na.height > nb.height)) {
+                pair_stack.push_back({na.child1, b}); pair_stack.push_back({na.child2, b});
+            } else {
+                pair_stack.push_back({a, nb.child1}); pair_stack.push_back({a, nb.child2});
+            }
+        }
+    }
+
+    // the body in slot from now lives in slot to; from is left without a leaf until the next update gives it one
+    void relocate(int from, int to) {
+        if ((uint32_t)from >= body_leaf.size()) return;
+        if ((uint32_t)to >= body_leaf.size()) body_leaf.resize(to + 1, NONE);
+        body_leaf[to] = body_leaf[from]; body_leaf[from] = NONE;
+        if (body_leaf[to] != NONE) nodes[body_leaf[to]].body = to;
+    }
+
+    // the bodies have been permuted, body i now lives in slot new_slot[i]
+    void remap(const std::vector<uint32_t>& new_slot) {
+        leaf_scratch.assign(body_leaf.size(), NONE);
+        for (uint32_t i = 0; i < body_leaf.size(); i++) {
+            if (body_leaf[i] == NONE) continue;
+            leaf_scratch[new_slot[i]] = body_leaf[i];
+            nodes[body_leaf[i]].body = new_slot[i];
+        }
+        body_leaf.swap(leaf_scratch);
+    }
+    // drops the leaf of a removed body, the node goes back on the free list
+    void remove(int body) {
+        if ((uint32_t)body >= body_leaf.size() || body_leaf[body] == NONE) return;
+        removeLeaf(body_leaf[body]);
+        freeNode(body_leaf[body]);
+        body_leaf[body] = NONE;
+    }
+
+    AABB fatten(const AABB& b) const {
+        const float m = margin + margin_fraction*std::max(b.max_x - b.min_x, b.max_y - b.min_y);
+        return {b.min_x - m, b.min_y - m, b.max_x + m, b.max_y + m};
+    }
+    static AABB combine(const AABB& a, const AABB& b) {
+        return {std::min(a.min_x, b.min_x), std::min(a.min_y, b.min_y), std::max(a.max_x, b.max_x), std::max(a.max_y, b.max_y)};
+    }
+    static float perimeter(const AABB& b) {return 2*(b.max_x - b.min_x + b.max_y - b.min_y);}
+
+    int allocateNode() {
+        if (free_list == NONE) {nodes.push_back(Node()); free_list = nodes.size() - 1; nodes.back().parent = NONE;}
+        const int index = free_list;
+        free_list = nodes[index].parent;
+        nodes[index].parent = nodes[index].child1 = nodes[index].child2 = NONE;
+        nodes[index].height = 0; nodes[index].body = NONE;
+        return index;
+    }
+    void freeNode(int index) {nodes[index].parent = free_list; nodes[index].height = -1; free_list = index;}
+
+    int createLeaf(const AABB& b, int body) {
+        const int leaf = allocateNode();
+        nodes[leaf].box = fatten(b); nodes[leaf].body = body;
+        insertLeaf(leaf);
+        return leaf;
+    }
+
+    void insertLeaf(int leaf) {
+        if (root == NONE) {root = leaf; nodes[root].parent = NONE; return;}
+        const AABB box = nodes[leaf].box;
+        int index = root;
+        while (!nodes[index].isLeaf()) {
+            const Node& node = nodes[index];
+            const float area = perimeter(node.box), combined_area = perimeter(combine(node.box, box));
+            const float cost = 2*combined_area, inheritance = 2*(combined_area - area);
+            float cost1 = perimeter(combine(box, nodes[node.child1].box)) + inheritance;
+            if (!nodes[node.child1].isLeaf()) cost1 -= perimeter(nodes[node.child1].box);
+            float cost2 = perimeter(combine(box, nodes[node.child2].box)) + inheritance;
+            if (!nodes[node.child2].isLeaf()) cost2 -= perimeter(nodes[node.child2].box);
+            if (cost < cost1 && cost < cost2) break;
+            index = cost1 < cost2 ? node.child1 : node.child2;
+        }
+        const int sibling = index, old_parent = nodes[sibling].parent, new_parent = allocateNode();
+        nodes[new_parent].parent = old_parent;
+        nodes[new_parent].box = combine(box, nodes[sibling].box);
+        nodes[new_parent].height = nodes[sibling].height + 1;
+        nodes[new_parent].child1 = sibling; nodes[new_parent].child2 = leaf;
+        nodes[sibling].parent = new_parent; nodes[leaf].parent = new_parent;
+        if (old_parent == NONE) root = new_parent;
+        else if (nodes[old_parent].child1 == sibling) nodes[old_parent].child1 = new_parent;
+        else nodes[old_parent].child2 = new_parent;
+        refit(nodes[leaf].parent);
+    }
+
+    void removeLeaf(int leaf) {
+        if (leaf == root) {root = NONE; return;}
+        const int parent = nodes[leaf].parent, grand_parent = nodes[parent].parent;
+        const int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+        freeNode(parent);
+        nodes[sibling].parent = grand_parent;
+        if (grand_parent == NONE) {root = sibling; return;}
+        if (nodes[grand_parent].child1 == parent) nodes[grand_parent].child1 = sibling;
+        else nodes[grand_parent].child2 = sibling;
+        refit(grand_parent);
+    }
+
+    void refit(int index) {
+        while (index != NONE) {
+            index = balance(index);
+            Node& node = nodes[index];
+            node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+            node.box = combine(nodes[node.child1].box, nodes[node.child2].box);
+            index = node.parent;
+        }
+    }
+
+    // Tree rotation after Kensler / Box2D v3: swaps a child of a with a grandchild on the other side when that shrinks
+    // the perimeter of the internal node in between. Rotating by perimeter rather than by height keeps a huge body near
+    // the root instead of letting it drag every small body below it into one spatially mixed subtree.
+    int balance(int a) {
+        if (nodes[a].height < 2) return a;
+        const int b = nodes[a].child1, c = nodes[a].child2;
+        float best = 0; int from = NONE, to = NONE, parent = NONE;
+        auto consider = [&](int child, int inner, int keep, int other) { // swap child with the grandchild inner below other
+            const float cost = perimeter(combine(nodes[child].box, nodes[keep].box)) - perimeter(nodes[other].box);
+            if (cost < best) {best = cost; from = child; to = inner; parent = other;}
+        };
+        if (!nodes[c].isLeaf()) {consider(b, nodes[c].child1, nodes[c].child2, c); consider(b, nodes[c].child2, nodes[c].child1, c);}
+        if (!nodes[b].isLeaf()) {consider(c, nodes[b].child1, nodes[b].child2, b); consider(c, nodes[b].child2, nodes[b].child1, b);}
+        if (from == NONE) return a;
+        if (nodes[a].child1 == from) nodes[a].child1 = to; else nodes[a].child2 = to;
+        if (nodes[parent].child1 == to) nodes[parent].child1 = from; else nodes[parent].child2 = from;
+        nodes[to].parent = a; nodes[from].parent = parent;
+        nodes[parent].box = combine(nodes[nodes[parent].child1].box, nodes[nodes[parent].child2].box);
+        nodes[parent].height = 1 + std::max(nodes[nodes[parent].child1].height, nodes[nodes[parent].child2].height);
+        return a;
+    }
+};
@@ -0,0 +1,19 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+// CSR lists of the constraints touching every body: ends[offsets[i] .. offsets[i + 1]] holds constraint*2 + 1 where
+// body i is end b and constraint*2 where it is end a, in constraint order. Built with a counting sort over the ends.
+struct Adjacency {
+    std::vector<uint32_t> offsets, ends, fill;
+
+    void build(const uint32_t* a, const uint32_t* b, uint32_t n, uint32_t bodies) {
+        offsets.assign(bodies + 1, 0);
+        for (uint32_t i = 0; i < n; i++) {offsets[a[i] + 1]++; offsets[b[i] + 1]++;}
+        for (uint32_t i = 0; i < bodies; i++) offsets[i + 1] += offsets[i];
+        ends.resize(2*n);
+        fill.assign(offsets.begin(), offsets.end() - 1);
+        for (uint32_t i = 0; i < n; i++) {ends[fill[a[i]]++] = 2*i; ends[fill[b[i]]++] = 2*i + 1;}
+    }
+    uint32_t degree(uint32_t body) const {return offsets[body + 1] - offsets[body];}
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Counts every heap allocation the program makes through operator new, by replacing the global operator new and
+// delete. The replacements are plain definitions, so a program includes this from exactly one translation unit (the
+// app and bench are one each). A count is a relaxed atomic add, cheap enough to always leave on. Over-aligned new
+// keeps the library's version and is not counted; nothing in the simulation allocates over-aligned types.
+struct AllocationCount {
+    uint64_t count, bytes;
+    AllocationCount operator-(const AllocationCount& o) const {return {count - o.count, bytes - o.bytes};}
+};
+
+struct AllocationCounter {
+    static inline std::atomic<uint64_t> count{0}, bytes{0};
+
+    static AllocationCount now() {return {count.load(std::memory_order_relaxed), bytes.load(std::memory_order_relaxed)};}
+    static void* allocate(size_t size) {
+        count.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+        return malloc(size ? size : 1);
+    }
+};
+
+void* operator new(size_t size) {
+    if (void* p = AllocationCounter::allocate(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) {
+    if (void* p = AllocationCounter::allocate(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {return AllocationCounter::allocate(size);}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {return AllocationCounter::allocate(size);}
+void operator delete(void* p) noexcept {free(p);}
+void operator delete[](void* p) noexcept {free(p);}
+void operator delete(void* p, size_t) noexcept {free(p);}
+void operator delete[](void* p, size_t) noexcept {free(p);}
+void operator delete(void* p, const std::nothrow_t&) noexcept {free(p);}
+void operator delete[](void* p, const std::nothrow_t&) noexcept {free(p);}
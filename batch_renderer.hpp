@@ -0,0 +1,87 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <vector>
+#include <math.h>
+
+// Collects every body of a frame into two triangle lists and draws each with a single call, so the cost of Scene::draw
+// no longer grows with one draw call per body. With shader support every circle is a quad whose texture coordinates
+// run from -1 to 1 across it and a fragment shader keeps the disc, antialiased over one pixel of its distance to the
+// rim. Without shaders each circle is tessellated into a fan of SEGMENTS triangles in the same array.
+//
+// Springs go into one persistent line buffer instead: the vertices are rewritten in place every frame and uploaded to
+// a streaming sf::VertexBuffer that is only recreated when the number of springs changes.
+struct BatchRenderer {
+    static constexpr int SEGMENTS = 24;
+    std::vector<sf::Vertex> circles, boxes, springs;
+    sf::VertexBuffer spring_buffer{sf::Lines, sf::VertexBuffer::Stream};
+    sf::Shader shader;
+    bool ready = false, use_shader = false, use_buffer = false;
+    float cos_table[SEGMENTS + 1], sin_table[SEGMENTS + 1];
+
+    // shader support can only be queried once a window (and with it a GL context) exists
+    void init() {
+        ready = true;
+        use_buffer = sf::VertexBuffer::isAvailable();
+        use_shader = sf::Shader::isAvailable() && shader.loadFromMemory(
+            "void main() {\n"
+            "    float d = length(gl_TexCoord[0].xy);\n"
+            "    float w = fwidth(d);\n"
+            "    gl_FragColor = vec4(gl_Color.rgb, gl_Color.a*(1.0 - smoothstep(1.0 - w, 1.0, d)));\n"
+            "}\n", sf::Shader::Fragment);
+        for (int k = 0; k <= SEGMENTS; k++) {
+            cos_table[k] = cos(2*3.14159265f*k/SEGMENTS); sin_table[k] = sin(2*3.14159265f*k/SEGMENTS);
+        }
+    }
+
+    void clear() {circles.clear(); boxes.clear();}
+
+    void addCircle(float x, float y, float r, sf::Color color) {
+        if (!ready) init();
+        if (use_shader) {
+            const sf::Vertex a(sf::Vector2f(x - r, y - r), color, sf::Vector2f(-1, -1)), b(sf::Vector2f(x + r, y - r), color, sf::Vector2f(1, -1));
+            const sf::Vertex c(sf::Vector2f(x + r, y + r), color, sf::Vector2f(1, 1)), d(sf::Vector2f(x - r, y + r), color, sf::Vector2f(-1, 1));
+            circles.push_back(a); circles.push_back(b); circles.push_back(c);
+            circles.push_back(a); circles.push_back(c); circles.push_back(d);
+            return;
+        }
+        const sf::Vertex centre(sf::Vector2f(x, y), color);
+        for (int k = 0; k < SEGMENTS; k++) {
+            circles.push_back(centre);
+            circles.push_back(sf::Vertex(sf::Vector2f(x + r*cos_table[k], y + r*sin_table[k]), color));
+            circles.push_back(sf::Vertex(sf::Vector2f(x + r*cos_table[k + 1], y + r*sin_table[k + 1]), color));
+        }
+    }
+
+    // the endpoints of spring i, so every spring keeps its two vertices from frame to frame
+    void setSpring(uint32_t i, sf::Vector2f a, sf::Vector2f b, sf::Color color_a, sf::Color color_b) {
+        sf::Vertex* v = &springs[2*i];
+        v[0].position = a; v[0].color = color_a;
+        v[1].position = b; v[1].color = color_b;
+    }
+    void resizeSprings(uint32_t count) {
+        if (!ready) init();
+        if (springs.size() == 2*count) return;
+        springs.resize(2*count);
+        if (use_buffer) use_buffer = spring_buffer.create(2*count);
+    }
+
+    // x, y is the centre like in Bodies
+    void addBox(float x, float y, float half_w, float half_h, sf::Color color) {
+        const sf::Vertex a(sf::Vector2f(x - half_w, y - half_h), color), b(sf::Vector2f(x + half_w, y - half_h), color);
+        const sf::Vertex c(sf::Vector2f(x + half_w, y + half_h), color), d(sf::Vector2f(x - half_w, y + half_h), color);
+        boxes.push_back(a); boxes.push_back(b); boxes.push_back(c);
+        boxes.push_back(a); boxes.push_back(c); boxes.push_back(d);
+    }
+
+    void draw(sf::RenderTarget& target) {
+        if (!circles.empty()) {
+            sf::RenderStates states;
+            if (use_shader) states.shader = &shader;
+            target.draw(&circles[0], circles.size(), sf::Triangles, states);
+        }
+        if (!boxes.empty()) target.draw(&boxes[0], boxes.size(), sf::Triangles);
+        if (springs.empty()) return;
+        if (use_buffer && spring_buffer.update(&springs[0])) target.draw(spring_buffer);
+        else target.draw(&springs[0], springs.size(), sf::Lines);
+    }
+};
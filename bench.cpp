@@ -0,0 +1,233 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "scenarios.hpp"
+#include "perf_counters.hpp"
+#include "checkpoint.hpp"
+#include "alloc_counter.hpp"
+#include "sim_thread.hpp"
+
+// Headless benchmark: runs the canned scenarios on the same Scene code as the app, without a window, and prints one JSON
+// object per scenario. Example: ./bench --scenario gas --bodies 100000 --steps 500 --broadphase sap --threads 8
+// Cache counters come from perf_event_open for the main thread only and print as null where the kernel has none.
+// --save writes a checkpoint once the warmup is done; --restore starts from one instead of the scenario's setup and
+// warmup, keeping the checkpoint's scene settings and taking only the thread count and SIMD level from the options.
+// --scenario then has to name the one scenario the checkpoint was saved from, with --bodies as it was, since they
+// still drive its spawning; the JSON gives the file as "restored" and the body count it held as "restored_bodies".
+// --record writes the timed steps to a trajectory file. --trace writes the trace scopes of the whole run as Chrome trace
+// JSON, which needs a build with PHYSICS_PROFILE (make bench PROFILE=1). Heap allocations during the timed steps are
+// always counted; with --zero-alloc on, any allocation there fails the run with exit code 3. The warmup then defaults to
+// ZERO_ALLOC_WARMUP steps, long enough for every buffer to reach the size it keeps in the steady state. --frames on runs
+// every step as a frame of the app instead, through SimThread: a posted command standing in for a key press, the tick
+// and the published snapshot, so the zero allocation check covers the frame loop short of drawing; make
+// zero_alloc_check runs it over every scenario. --stage-counters on also
+// counts cycles, instructions, cache and branch misses around every stage (Linux perf_event_open, null where the
+// machine has no counters) and reports the instructions per cycle and the counts per body and step of each stage.
+
+struct Options {
+    std::string scenario = "all", save, restore, record, trace;
+    uint32_t bodies = 0; // 0 keeps the scenario's default
+    uint32_t steps = 1000, warmup = ~0u, threads = 1; // warmup ~0u picks 50, or ZERO_ALLOC_WARMUP with --zero-alloc on
+    bool sleep = false, zero_alloc = false, stage_counters = false, frames = false;
+    int reorder = 0;
+    uint64_t seed = 1;
+    float dt = 1.f/480;
+    int broadphase = UNIFORM_GRID, simd = -1, solver = SOLVER_FORCES, iterations = 4, integrator = INTEGRATOR_EULER;
+};
+
+const uint32_t ZERO_ALLOC_WARMUP = 3000;
+
+static void usage() {
+    fprintf(stderr, "usage: bench [--scenario all|lattice|gas|pile|rain] [--bodies n] [--steps n] [--warmup n] [--seed n]\n"
+                    "             [--dt seconds] [--broadphase brute|grid|tree|sap] [--threads n] [--simd scalar|sse2|avx2]\n"
+                    "             [--solver forces|xpbd|jacobi] [--iterations n] [--integrator euler|verlet|velocity|leapfrog|yoshida]\n"
+                    "             [--sleep on|off] [--reorder steps] [--save file] [--restore file]\n"
+                    "             [--record file] [--trace file] [--zero-alloc on|off] [--stage-counters on|off]\n"
+                    "             [--frames on|off]\n");
+}
+
+static int lookup(const char* name, const char* const* names, int count) {
+    for (int i = 0; i < count; i++) if (!strcmp(name, names[i])) return i;
+    return -1;
+}
+
+static bool parse(int argc, char** argv, Options& o) {
+    const char* const short_broadphase[] = {"brute", "grid", "tree", "sap"};
+    const char* const short_solver[] = {"forces", "xpbd", "jacobi"};
+    const char* const short_integrator[] = {"euler", "verlet", "velocity", "leapfrog", "yoshida"};
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) return false;
+        const char* key = argv[i], * value = argv[++i];
+        if (!strcmp(key, "--scenario")) o.scenario = value;
+        else if (!strcmp(key, "--bodies")) o.bodies = strtoul(value, nullptr, 10);
+        else if (!strcmp(key, "--steps")) o.steps = strtoul(value, nullptr, 10);
+        else if (!strcmp(key, "--warmup")) o.warmup = strtoul(value, nullptr, 10);
+        else if (!strcmp(key, "--seed")) o.seed = strtoull(value, nullptr, 10);
+        else if (!strcmp(key, "--dt")) o.dt = strtof(value, nullptr);
+        else if (!strcmp(key, "--threads")) o.threads = strtoul(value, nullptr, 10);
+        else if (!strcmp(key, "--broadphase")) {if ((o.broadphase = lookup(value, short_broadphase, BROADPHASE_COUNT)) < 0) return false;}
+        else if (!strcmp(key, "--iterations")) o.iterations = atoi(value);
+        else if (!strcmp(key, "--solver")) {if ((o.solver = lookup(value, short_solver, SOLVER_COUNT)) < 0) return false;}
+        else if (!strcmp(key, "--integrator")) {if ((o.integrator = lookup(value, short_integrator, INTEGRATOR_COUNT)) < 0) return false;}
+        else if (!strcmp(key, "--reorder")) o.reorder = atoi(value);
+        else if (!strcmp(key, "--sleep")) o.sleep = !strcmp(value, "on");
+        else if (!strcmp(key, "--save")) o.save = value;
+        else if (!strcmp(key, "--restore")) o.restore = value;
+        else if (!strcmp(key, "--record")) o.record = value;
+        else if (!strcmp(key, "--trace")) o.trace = value;
+        else if (!strcmp(key, "--zero-alloc")) o.zero_alloc = !strcmp(value, "on");
+        else if (!strcmp(key, "--stage-counters")) o.stage_counters = !strcmp(value, "on");
+        else if (!strcmp(key, "--frames")) o.frames = !strcmp(value, "on");
+        else if (!strcmp(key, "--simd")) {if ((o.simd = lookup(value, simd_names, SIMD_AVX2 + 1)) < 0) return false;}
+        else return false;
+    }
+    if (!o.restore.empty() && o.scenario == "all") {fprintf(stderr, "--restore needs the --scenario the checkpoint was saved from\n"); return false;}
+    if (o.warmup == ~0u) o.warmup = o.zero_alloc ? ZERO_ALLOC_WARMUP : 50;
+    return true;
+}
+
+// ipc and then every stage event per body and step, by stage; null for what the machine does not count
+static void printStageCounters(const StageTimer& timer, const PerfGroup& counters, double body_steps) {
+    printf(",\n   \"stage_counters\": ");
+    if (!counters.available()) {printf("null"); return;}
+    printf("{");
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        const double* events = timer.events[s];
+        const double cycles = events[0], instructions = events[1]; // stage_events starts with these two
+        printf("%s\n    \"%s\": {", s ? "," : "", stage_names[s]);
+        if (counters.available(0) && counters.available(1) && cycles > 0) printf("\"ipc\": %.3f", instructions/cycles);
+        else printf("\"ipc\": null");
+        for (int e = 0; e < STAGE_EVENT_COUNT; e++) {
+            if (counters.available(e)) printf(", \"%s_per_body\": %.3f", perf_event_names[stage_events[e]], body_steps > 0 ? events[e]/body_steps : 0.0);
+            else printf(", \"%s_per_body\": null", perf_event_names[stage_events[e]]);
+        }
+        printf("}");
+    }
+    printf("}");
+}
+
+// false when --zero-alloc is on and the timed steps allocated
+static bool run(const Scenario& scenario, const Options& o, bool last) {
+    typedef std::chrono::steady_clock Clock;
+    const uint32_t bodies = o.bodies ? o.bodies : scenario.default_bodies;
+    Scene scene(sf::Vector2f(0, 0), 0.1f);
+    scene.rng = Rng(o.seed);
+    scene.broadphase = (BroadphaseMode)o.broadphase;
+    scene.thread_pool.resize(o.threads);
+    scene.solver = (Solver)o.solver; scene.xpbd.iterations = o.iterations;
+    scene.integrator = (Integrator)o.integrator; scene.allow_sleep = o.sleep;
+    scene.morton.interval = o.reorder;
+    // without --simd the scene keeps its default, the widest level the CPU supports
+    if (o.simd > scene.circle_batches.supported) fprintf(stderr, "%s not supported, running %s\n", simd_names[o.simd], simd_names[scene.circle_batches.level]);
+    else if (o.simd >= 0) scene.circle_batches.level = (SimdLevel)o.simd;
+    uint64_t step = 0;
+    uint32_t restored_bodies = 0;
+    double save_ms = 0, restore_ms = 0;
+    // with --frames on a step is a whole frame of the app, one fixed step long
+    SimThread sim(&scene);
+    auto advance = [&](float dt) {
+        if (!o.frames) {scene.update(dt); return;}
+        sim.post([](Scene&) {});
+        sim.tick(scene.step);
+    };
+    if (!o.restore.empty()) {
+        const Clock::time_point start = Clock::now();
+        if (!loadCheckpoint(scene, o.restore.c_str())) {fprintf(stderr, "cannot restore %s\n", o.restore.c_str()); exit(1);}
+        restore_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        restored_bodies = scene.bodies.size();
+        step = o.warmup;
+    } else {
+        scenario.setup(scene, bodies);
+        scene.step = o.dt;
+        for (; step < o.warmup; step++) {
+            if (scenario.spawn) scenario.spawn(scene, step, bodies);
+            advance(o.dt);
+        }
+    }
+    if (!o.save.empty()) {
+        const Clock::time_point start = Clock::now();
+        if (!saveCheckpoint(scene, o.save.c_str())) {fprintf(stderr, "cannot save %s\n", o.save.c_str()); exit(1);}
+        save_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+    Recorder recorder;
+    if (!o.record.empty()) {
+        if (!recorder.open(o.record.c_str())) {fprintf(stderr, "cannot record to %s\n", o.record.c_str()); exit(1);}
+        scene.recorder = &recorder;
+    }
+    StageTimer timer;
+    scene.timer = &timer;
+    PerfGroup stage_counters;
+    if (o.stage_counters && stage_counters.open(stage_events, STAGE_EVENT_COUNT)) timer.counters = &stage_counters;
+    PerfCounter counters[PERF_EVENT_COUNT];
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) counters[e].open((PerfEvent)e);
+    double body_steps = 0;
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) counters[e].start();
+    stage_counters.start();
+    const AllocationCount allocations_before = AllocationCounter::now();
+    const Clock::time_point start = Clock::now();
+    for (uint32_t i = 0; i < o.steps; i++, step++) {
+        if (scenario.spawn) scenario.spawn(scene, step, bodies);
+        body_steps += scene.bodies.size();
+        advance(o.dt);
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const AllocationCount allocations = AllocationCounter::now() - allocations_before;
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) counters[e].stop();
+    stage_counters.stop();
+    scene.timer = nullptr;
+    scene.recorder = nullptr;
+    if (!recorder.close()) {fprintf(stderr, "cannot write %s\n", o.record.c_str()); exit(1);}
+
+    printf("  {\"scenario\": \"%s\", \"bodies\": %u, \"springs\": %u, \"steps\": %u, \"dt\": %g, \"seed\": %llu,\n",
+           scenario.name, scene.bodies.size(), scene.springs.size(), o.steps, o.dt, (unsigned long long)o.seed);
+    printf("   \"solver\": \"%s\", \"iterations\": %d, \"integrator\": \"%s\", \"broadphase\": \"%s\", \"threads\": %u, \"simd\": \"%s\",\n",
+           solver_names[scene.solver], scene.xpbd.iterations, integrator_names[scene.integrator], broadphase_names[scene.broadphase], scene.thread_pool.size(),
+           simd_names[scene.circle_batches.level]);
+    printf("   \"frames\": %s, \"sleep\": %s, \"sleeping\": %u, \"reorder\": %d, \"save_ms\": %.3f, \"restore_ms\": %.3f,\n",
+           o.frames ? "true" : "false", scene.allow_sleep ? "true" : "false", scene.islands.sleeping, scene.morton.interval, save_ms, restore_ms);
+    if (!o.restore.empty()) printf("   \"restored\": \"%s\", \"restored_bodies\": %u,\n", o.restore.c_str(), restored_bodies);
+    else printf("   \"restored\": null,\n");
+    printf("   \"seconds\": %.6f, \"steps_per_sec\": %.3f, \"ns_per_body_step\": %.3f,\n", seconds, o.steps/seconds,
+           body_steps > 0 ? seconds*1e9/body_steps : 0.0);
+    if (!o.record.empty())
+        printf("   \"recorded_frames\": %llu, \"recorded_bytes\": %llu, \"record_dropped\": %llu,\n", (unsigned long long)recorder.frames,
+               (unsigned long long)recorder.bytes, (unsigned long long)recorder.dropped);
+    printf("   \"allocations\": %llu, \"allocations_per_step\": %.3f, \"allocated_bytes_per_step\": %.1f,\n",
+           (unsigned long long)allocations.count, o.steps ? (double)allocations.count/o.steps : 0.0, o.steps ? (double)allocations.bytes/o.steps : 0.0);
+    printf("   \"counters_per_step\": {");
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        if (counters[e].available()) printf("%s\"%s\": %.1f", e ? ", " : "", perf_event_names[e], o.steps ? (double)counters[e].read()/o.steps : 0.0);
+        else printf("%s\"%s\": null", e ? ", " : "", perf_event_names[e]);
+    }
+    printf("},\n");
+    printf("   \"stage_ms_per_step\": {");
+    for (int s = 0; s < STAGE_COUNT; s++)
+        printf("%s\"%s\": %.6f", s ? ", " : "", stage_names[s], o.steps ? timer.seconds[s]*1e3/o.steps : 0.0);
+    printf("}");
+    if (o.stage_counters) printStageCounters(timer, stage_counters, body_steps);
+    printf("}%s\n", last ? "" : ",");
+    if (o.zero_alloc && allocations.count) {
+        fprintf(stderr, "%s: %llu allocations in %u steps after warmup\n", scenario.name, (unsigned long long)allocations.count, o.steps);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Options o;
+    if (!parse(argc, argv, o)) {usage(); return 1;}
+#ifndef PHYSICS_PROFILE
+    if (!o.trace.empty()) {fprintf(stderr, "--trace needs a build with PHYSICS_PROFILE, see profiler.hpp\n"); return 1;}
+#endif
+    std::vector<const Scenario*> selected;
+    for (int i = 0; i < SCENARIO_COUNT; i++) if (o.scenario == "all" || o.scenario == scenarios[i].name) selected.push_back(&scenarios[i]);
+    if (selected.empty()) {usage(); return 1;}
+    printf("[\n");
+    bool allocation_free = true;
+    for (uint32_t i = 0; i < selected.size(); i++) allocation_free &= run(*selected[i], o, i + 1 == selected.size());
+    printf("]\n");
+#ifdef PHYSICS_PROFILE
+    if (!o.trace.empty() && !Profiler::instance().writeChromeTrace(o.trace.c_str())) {fprintf(stderr, "cannot write %s\n", o.trace.c_str()); return 1;}
+#endif
+    return allocation_free ? 0 : 3;
+}
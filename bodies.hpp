@@ -0,0 +1,128 @@
+#pragma once
+#include <SFML/System/Vector2.hpp>
+#include <vector>
+#include <cstdint>
+#include <math.h>
+#include "handles.hpp"
+#include "thread_pool.hpp"
+
+enum {CIRCLE, BOX, POLYGON};
+const int SHAPE_COUNT = POLYGON; // polygons are not implemented yet
+const int GROUP_COUNT = 4; // colour groups, the renderer has a colour for each
+enum {STATIC = 1, SLEEPING = 2};
+
+// Body state as a structure of arrays, so each pass of Scene::update streams through the few columns it touches
+// instead of pulling a whole heap object per body. Positions are centres for every shape; half_w/half_h are the
+// half extents (both equal to the radius for circles). rest_time is how long the body's island has been resting, see
+// Islands.
+//
+// Bodies are kept sorted by shape: pool[s] .. pool[s+1] is the contiguous range holding every body of shape s, so the
+// narrowphase and the renderer run one homogeneous loop per shape. Handles stay valid while bodies move around in the
+// arrays, see Handles; removing a body fills its slot from the end of its pool and every later pool closes the gap the
+// same way, so adding and removing are both O(SHAPE_COUNT) moves and never leave holes.
+struct Bodies {
+    std::vector<float> x, y, x_old, y_old, vx, vy, ax, ay, inv_mass, half_w, half_h, rest_time;
+    std::vector<int8_t> shape, group;
+    std::vector<uint8_t> flags;
+    Handles handles;
+    uint32_t pool[SHAPE_COUNT + 1] = {};
+    // gather buffers for permute, each ends up holding the previous storage of the last column gathered through it
+    std::vector<float> float_scratch;
+    std::vector<int8_t> int8_scratch;
+    std::vector<uint8_t> uint8_scratch;
+    std::vector<uint32_t> uint32_scratch;
+
+    uint32_t size() const {return x.size();}
+    uint32_t begin(int shape) const {return pool[shape];}
+    uint32_t end(int shape) const {return pool[shape + 1];}
+
+    // appends a slot, then opens it up at the end of the shape's pool by moving the first body of every later pool to
+    // that pool's end; returns the moves made so the owner can patch anything holding slot indices
+    uint32_t add(float x, float y, float half_w, float half_h, float mass, bool is_static, int8_t shape, int8_t group,
+                 std::vector<std::pair<uint32_t, uint32_t>>& moves) {
+        this->x.push_back(0); this->y.push_back(0); x_old.push_back(0); y_old.push_back(0);
+        vx.push_back(0); vy.push_back(0); ax.push_back(0); ay.push_back(0); inv_mass.push_back(0);
+        this->half_w.push_back(0); this->half_h.push_back(0); rest_time.push_back(0); this->shape.push_back(0);
+        this->group.push_back(0); flags.push_back(0); handles.handle.push_back(0);
+        uint32_t slot = pool[SHAPE_COUNT]++;
+        for (int t = SHAPE_COUNT - 1; t > shape; t--) {
+            if (pool[t] != slot) {move(pool[t], slot); moves.push_back({pool[t], slot});}
+            slot = pool[t]++;
+        }
+        this->x[slot] = x_old[slot] = x; this->y[slot] = y_old[slot] = y;
+        vx[slot] = vy[slot] = ax[slot] = ay[slot] = 0;
+        inv_mass[slot] = is_static || mass <= 0 ? 0.f : 1/mass;
+        this->half_w[slot] = half_w; this->half_h[slot] = half_h; rest_time[slot] = 0;
+        this->shape[slot] = shape; this->group[slot] = group; flags[slot] = is_static ? STATIC : 0;
+        return handles.create(slot);
+    }
+    // the reverse of add: fills the slot with the last body of its pool, then the gap that leaves at the start of the
+    // next pool with that pool's last body and so on, and pops the end; the handle of the body becomes invalid
+    void remove(uint32_t slot, std::vector<std::pair<uint32_t, uint32_t>>& moves) {
+        handles.destroy(slot);
+        for (int t = shape[slot]; t < SHAPE_COUNT; t++) {
+            const uint32_t last = --pool[t + 1];
+            if (last != slot) {move(last, slot); moves.push_back({last, slot});}
+            slot = last;
+        }
+        x.pop_back(); y.pop_back(); x_old.pop_back(); y_old.pop_back(); vx.pop_back(); vy.pop_back(); ax.pop_back(); ay.pop_back();
+        inv_mass.pop_back(); half_w.pop_back(); half_h.pop_back(); rest_time.pop_back(); shape.pop_back(); group.pop_back();
+        flags.pop_back(); handles.handle.pop_back();
+    }
+    void move(uint32_t from, uint32_t to) {
+        x[to] = x[from]; y[to] = y[from]; x_old[to] = x_old[from]; y_old[to] = y_old[from];
+        vx[to] = vx[from]; vy[to] = vy[from]; ax[to] = ax[from]; ay[to] = ay[from]; inv_mass[to] = inv_mass[from];
+        half_w[to] = half_w[from]; half_h[to] = half_h[from]; rest_time[to] = rest_time[from];
+        shape[to] = shape[from]; group[to] = group[from]; flags[to] = flags[from]; handles.move(from, to);
+    }
+    // rearranges the bodies so that slot i holds the body that was in slot order[i]; order must keep every body inside
+    // its pool. Handles follow their bodies.
+    void permute(const std::vector<uint32_t>& order, ThreadPool& thread_pool) {
+        for (std::vector<float>* column : {&x, &y, &x_old, &y_old, &vx, &vy, &ax, &ay, &inv_mass, &half_w, &half_h, &rest_time})
+            gather(*column, order, float_scratch, thread_pool);
+        gather(shape, order, int8_scratch, thread_pool); gather(group, order, int8_scratch, thread_pool);
+        gather(flags, order, uint8_scratch, thread_pool);
+        gather(handles.handle, order, uint32_scratch, thread_pool);
+        for (uint32_t i = 0; i < size(); i++) handles.index[handles.handle[i]] = i;
+    }
+    template <class T> static void gather(std::vector<T>& column, const std::vector<uint32_t>& order, std::vector<T>& scratch,
+                                          ThreadPool& thread_pool) {
+        scratch.reserve(column.capacity()); // keeps what reserve() set aside
+        scratch.resize(column.size());
+        thread_pool.parallelFor(column.size(), 16384, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) scratch[i] = column[order[i]];
+        });
+        column.swap(scratch);
+    }
+    void reserve(uint32_t n) {
+        x.reserve(n); y.reserve(n); x_old.reserve(n); y_old.reserve(n); vx.reserve(n); vy.reserve(n); ax.reserve(n); ay.reserve(n);
+        inv_mass.reserve(n); half_w.reserve(n); half_h.reserve(n); rest_time.reserve(n); shape.reserve(n); group.reserve(n);
+        flags.reserve(n); handles.reserve(n);
+    }
+};
+
+// Lightweight handle so scene setup code can keep creating and editing bodies without knowing the storage layout.
+// Only valid() may be called once the body has been removed.
+struct Body {
+    Bodies* bodies; uint32_t id, generation;
+
+    bool valid() const {return bodies->handles.valid(id, generation);}
+    uint32_t slot() const {return bodies->handles.index[id];}
+    sf::Vector2f position() const {return sf::Vector2f(bodies->x[slot()], bodies->y[slot()]);}
+    sf::Vector2f velocity() const {return sf::Vector2f(bodies->vx[slot()], bodies->vy[slot()]);}
+    float radius() const {return bodies->half_w[slot()];}
+    float mass() const {return bodies->inv_mass[slot()] > 0 ? 1/bodies->inv_mass[slot()] : INFINITY;}
+    int8_t group() const {return bodies->group[slot()];}
+    bool isStatic() const {return bodies->flags[slot()] & STATIC;}
+    bool isSleeping() const {return bodies->flags[slot()] & SLEEPING;}
+    // editing a sleeping body wakes it, Islands then wakes the rest of its island
+    void wake() {bodies->flags[slot()] &= ~SLEEPING; bodies->rest_time[slot()] = 0;}
+    void setPosition(sf::Vector2f position) {
+        wake();
+        const uint32_t i = slot();
+        bodies->x[i] = bodies->x_old[i] = position.x; bodies->y[i] = bodies->y_old[i] = position.y;
+    }
+    void setVelocity(sf::Vector2f velocity) {wake(); bodies->vx[slot()] = velocity.x; bodies->vy[slot()] = velocity.y;}
+    void setGroup(int8_t group) {bodies->group[slot()] = group;}
+    void applyAcceleration(sf::Vector2f acceleration) {wake(); bodies->ax[slot()] += acceleration.x; bodies->ay[slot()] += acceleration.y;}
+};
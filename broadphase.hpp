@@ -0,0 +1,92 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+struct AABB {
+    float min_x, min_y, max_x, max_y;
+    bool overlaps(const AABB& o) const {return min_x <= o.max_x && o.min_x <= max_x && min_y <= o.max_y && o.min_y <= max_y;}
+};
+
+struct BodyPair {uint32_t a, b;};
+
+enum BroadphaseMode {BRUTE_FORCE, UNIFORM_GRID, AABB_TREE, SWEEP_AND_PRUNE, BROADPHASE_COUNT};
+const char* const broadphase_names[] = {"brute force", "uniform grid", "AABB tree", "sweep and prune"};
+
+// every overlapping pair by testing all of them, for scenes small enough not to need anything better
+inline void bruteForcePairs(const std::vector<AABB>& bounds, std::vector<BodyPair>& pairs) {
+    pairs.clear();
+    for (uint32_t i = 0; i < bounds.size(); i++)
+        for (uint32_t j = i + 1; j < bounds.size(); j++) if (bounds[i].overlaps(bounds[j])) pairs.push_back({i, j});
+}
+
+// Cell lists rebuilt from scratch every step. Bodies are binned by the centre of their AABB into cells at least as
+// large as the biggest AABB, so any overlapping pair sits in the same or in adjacent cells and only half of the 3x3
+// neighbourhood has to be visited.
+struct UniformGrid {
+    UniformGrid(float cell_size = 0.f) {this->cell_size = cell_size;}
+    float cell_size; // 0 = fit to the largest body every step
+    int cols = 0, rows = 0;
+    float origin_x = 0, origin_y = 0, inv_cell = 0;
+    std::vector<uint32_t> cell_start, cell_bodies, body_cell;
+
+    void build(const std::vector<AABB>& bounds) {
+        const uint32_t n = bounds.size();
+        float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY, extent = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            const AABB& b = bounds[i];
+            min_x = std::min(min_x, b.min_x); min_y = std::min(min_y, b.min_y);
+            max_x = std::max(max_x, b.max_x); max_y = std::max(max_y, b.max_y);
+            extent = std::max(extent, std::max(b.max_x - b.min_x, b.max_y - b.min_y));
+        }
+        float size = std::max(cell_size, extent);
+        if (n == 0 || !(size > 0)) size = 1.f;
+        // sparse scenes with a few far-flung bodies would otherwise allocate a huge mostly-empty grid
+        const double max_cells = 4.0*n + 64;
+        while ((double)std::ceil((max_x - min_x)/size + 1)*std::ceil((max_y - min_y)/size + 1) > max_cells) size *= 2;
+        inv_cell = 1/size; origin_x = min_x; origin_y = min_y;
+        cols = n ? (int)((max_x - min_x)*inv_cell) + 1 : 1; rows = n ? (int)((max_y - min_y)*inv_cell) + 1 : 1;
+
+        // counting sort of the bodies by cell; reserving the cell bound up front keeps a grid whose extent creeps
+        // outwards from reallocating on every new maximum
+        cell_start.reserve((size_t)max_cells + 1);
+        cell_start.assign(cols*rows + 1, 0);
+        body_cell.resize(n); cell_bodies.resize(n);
+        for (uint32_t i = 0; i < n; i++) {
+            const AABB& b = bounds[i];
+            int cx = std::min(cols - 1, (int)((0.5f*(b.min_x + b.max_x) - origin_x)*inv_cell));
+            int cy = std::min(rows - 1, (int)((0.5f*(b.min_y + b.max_y) - origin_y)*inv_cell));
+            body_cell[i] = cy*cols + cx;
+            cell_start[body_cell[i] + 1]++;
+        }
+        for (int c = 0; c < cols*rows; c++) cell_start[c + 1] += cell_start[c];
+        for (uint32_t i = 0; i < n; i++) cell_bodies[cell_start[body_cell[i]]++] = i;
+        for (int c = cols*rows; c > 0; c--) cell_start[c] = cell_start[c - 1];
+        cell_start[0] = 0;
+    }
+
+    void findPairs(const std::vector<AABB>& bounds, std::vector<BodyPair>& pairs) {
+        build(bounds);
+        pairs.clear();
+        const int offsets[4][2] = {{1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+        for (int cy = 0; cy < rows; cy++) for (int cx = 0; cx < cols; cx++) {
+            const uint32_t c = cy*cols + cx, begin = cell_start[c], end = cell_start[c + 1];
+            for (uint32_t i = begin; i < end; i++) {
+                const uint32_t a = cell_bodies[i];
+                for (uint32_t j = i + 1; j < end; j++) testPair(bounds, a, cell_bodies[j], pairs);
+                for (int k = 0; k < 4; k++) {
+                    const int nx = cx + offsets[k][0], ny = cy + offsets[k][1];
+                    if (nx < 0 || nx >= cols || ny >= rows) continue;
+                    const uint32_t nc = ny*cols + nx;
+                    for (uint32_t j = cell_start[nc]; j < cell_start[nc + 1]; j++) testPair(bounds, a, cell_bodies[j], pairs);
+                }
+            }
+        }
+    }
+
+    static void testPair(const std::vector<AABB>& bounds, uint32_t a, uint32_t b, std::vector<BodyPair>& pairs) {
+        if (!bounds[a].overlaps(bounds[b])) return;
+        if (a < b) pairs.push_back({a, b}); else pairs.push_back({b, a});
+    }
+};
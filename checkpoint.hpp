@@ -0,0 +1,256 @@
+#pragma once
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include "mapped_file.hpp"
+#include "scene.hpp"
+
+// Binary checkpoints of a whole Scene. A file is a fixed header with every scalar of the scene, a table of columns and
+// then the raw contents of every column, each starting on a 64 byte boundary: the body and spring arrays with their
+// handle tables, and the persistent state of the AABB tree and of sweep and prune, whose pair order depends on their
+// history. Saving sizes the file, maps it and copies each column in once; loading maps the file, checks the header and
+// the table, and copies the columns straight into the scene's vectors, so restoring costs about a memcpy of the file.
+// Everything is stored in the host's byte order and layout; byte_order records which, so a file only loads on a machine
+// of the same byte order, with the same version and element sizes. Before anything is copied the contents are checked
+// too, every slot, handle and node index in range, so a damaged file is refused rather than read out of bounds later.
+//
+// Continuing from a checkpoint is bit for bit the same as continuing the scene that saved it, given the same thread
+// count and SIMD level; those are settings of the running program and are not part of the file.
+const uint32_t CHECKPOINT_VERSION = 1;
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version, byte_order, header_size, column_count;
+    uint64_t file_size;
+    uint64_t rng_state, steps;
+    uint32_t pool[SHAPE_COUNT + 1];
+    float gravity_x, gravity_y, air_resistance;
+    float step, accumulator, alpha;
+    int32_t max_steps, broadphase, solver, integrator, staggered;
+    int32_t allow_sleep, sleeping, morton_interval, xpbd_iterations;
+    float sleep_speed, time_to_sleep, relaxation, restitution, grid_cell_size;
+    int32_t tree_root, tree_free_list;
+    uint32_t sap_bodies;
+};
+struct CheckpointColumn {uint32_t element_size, reserved; uint64_t offset, count;};
+
+// the position of every column in the table; the per body and per spring columns are runs, see loadCheckpoint
+enum CheckpointColumnId {
+    CKPT_X, CKPT_Y, CKPT_X_OLD, CKPT_Y_OLD, CKPT_VX, CKPT_VY, CKPT_AX, CKPT_AY, CKPT_INV_MASS, CKPT_HALF_W, CKPT_HALF_H,
+    CKPT_REST_TIME, CKPT_SHAPE, CKPT_GROUP, CKPT_FLAGS,
+    CKPT_BODY_INDEX, CKPT_BODY_GENERATION, CKPT_BODY_HANDLE, CKPT_BODY_FREE,
+    CKPT_SPRING_A, CKPT_SPRING_B, CKPT_STIFFNESS, CKPT_DAMPING, CKPT_REST_LENGTH,
+    CKPT_SPRING_INDEX, CKPT_SPRING_GENERATION, CKPT_SPRING_HANDLE, CKPT_SPRING_FREE,
+    CKPT_TREE_NODES, CKPT_TREE_BODY_LEAF, CKPT_SAP_AXIS_X, CKPT_SAP_AXIS_Y, CKPT_SAP_PAIRS, CKPT_SAP_TABLE,
+    CKPT_COLUMN_COUNT};
+
+// calls f(id, vector) for every column, in file order; S is Scene or const Scene
+template <class S, class F> void checkpointColumns(S& scene, const F& f) {
+    auto& s = scene.bodies;
+    f(CKPT_X, s.x); f(CKPT_Y, s.y); f(CKPT_X_OLD, s.x_old); f(CKPT_Y_OLD, s.y_old);
+    f(CKPT_VX, s.vx); f(CKPT_VY, s.vy); f(CKPT_AX, s.ax); f(CKPT_AY, s.ay);
+    f(CKPT_INV_MASS, s.inv_mass); f(CKPT_HALF_W, s.half_w); f(CKPT_HALF_H, s.half_h); f(CKPT_REST_TIME, s.rest_time);
+    f(CKPT_SHAPE, s.shape); f(CKPT_GROUP, s.group); f(CKPT_FLAGS, s.flags);
+    f(CKPT_BODY_INDEX, s.handles.index); f(CKPT_BODY_GENERATION, s.handles.generation);
+    f(CKPT_BODY_HANDLE, s.handles.handle); f(CKPT_BODY_FREE, s.handles.free);
+    auto& springs = scene.springs;
+    f(CKPT_SPRING_A, springs.a); f(CKPT_SPRING_B, springs.b);
+    f(CKPT_STIFFNESS, springs.stiffness); f(CKPT_DAMPING, springs.damping); f(CKPT_REST_LENGTH, springs.rest_length);
+    f(CKPT_SPRING_INDEX, springs.handles.index); f(CKPT_SPRING_GENERATION, springs.handles.generation);
+    f(CKPT_SPRING_HANDLE, springs.handles.handle); f(CKPT_SPRING_FREE, springs.handles.free);
+    f(CKPT_TREE_NODES, scene.tree.nodes); f(CKPT_TREE_BODY_LEAF, scene.tree.body_leaf);
+    f(CKPT_SAP_AXIS_X, scene.sap.axis[0]); f(CKPT_SAP_AXIS_Y, scene.sap.axis[1]);
+    f(CKPT_SAP_PAIRS, scene.sap.pairs); f(CKPT_SAP_TABLE, scene.sap.table);
+}
+
+inline uint64_t checkpointAlign(uint64_t offset) {return (offset + 63) & ~(uint64_t)63;}
+
+inline bool saveCheckpoint(const Scene& scene, const char* path) {
+    const uint32_t columns = CKPT_COLUMN_COUNT;
+    uint64_t size = checkpointAlign(sizeof(CheckpointHeader) + columns*sizeof(CheckpointColumn));
+    checkpointColumns(scene, [&](int, const auto& column) {size = checkpointAlign(size + column.size()*sizeof(column[0]));});
+
+    MappedFile file;
+    if (!file.create(path, size)) return false;
+    char* out = (char*)file.data;
+    CheckpointHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "PHYSCKPT", 8);
+    h.version = CHECKPOINT_VERSION; h.byte_order = 0x01020304; h.header_size = sizeof(h); h.column_count = columns;
+    h.file_size = size;
+    h.rng_state = scene.rng.state; h.steps = scene.steps;
+    for (int k = 0; k <= SHAPE_COUNT; k++) h.pool[k] = scene.bodies.pool[k];
+    h.gravity_x = scene.gravity.x; h.gravity_y = scene.gravity.y; h.air_resistance = scene.air_resistance;
+    h.step = scene.step; h.accumulator = scene.accumulator; h.alpha = scene.alpha; h.max_steps = scene.max_steps;
+    h.broadphase = scene.broadphase; h.solver = scene.solver; h.integrator = scene.integrator; h.staggered = scene.staggered;
+    h.allow_sleep = scene.allow_sleep; h.sleeping = scene.islands.sleeping; h.morton_interval = scene.morton.interval;
+    h.xpbd_iterations = scene.xpbd.iterations;
+    h.sleep_speed = scene.islands.sleep_speed; h.time_to_sleep = scene.islands.time_to_sleep;
+    h.relaxation = scene.xpbd.relaxation; h.restitution = scene.xpbd.restitution; h.grid_cell_size = scene.grid.cell_size;
+    h.tree_root = scene.tree.root; h.tree_free_list = scene.tree.free_list; h.sap_bodies = scene.sap.bodies;
+    memcpy(out, &h, sizeof(h));
+
+    CheckpointColumn* table = (CheckpointColumn*)(out + sizeof(h));
+    uint64_t offset = checkpointAlign(sizeof(h) + columns*sizeof(CheckpointColumn));
+    checkpointColumns(scene, [&](int id, const auto& column) {
+        const uint64_t bytes = column.size()*sizeof(column[0]);
+        table[id] = {(uint32_t)sizeof(column[0]), 0, offset, column.size()};
+        if (bytes) memcpy(out + offset, column.data(), bytes);
+        offset = checkpointAlign(offset + bytes);
+    });
+    return true;
+}
+
+template <class T> const T* checkpointData(const char* in, const CheckpointColumn* table, int id) {return (const T*)(in + table[id].offset);}
+
+// the handle table of bodies or springs: every slot's handle maps back to it, every used handle to its slot, and
+// every free handle is unused
+inline bool checkpointHandlesValid(const uint32_t* index, uint64_t ids, const uint32_t* handle, uint64_t slots,
+                                   const uint32_t* free, uint64_t frees) {
+    for (uint64_t i = 0; i < slots; i++) if (handle[i] >= ids || index[handle[i]] != i) return false;
+    for (uint64_t id = 0; id < ids; id++) if (index[id] != Handles::NONE && (index[id] >= slots || handle[index[id]] != id)) return false;
+    for (uint64_t k = 0; k < frees; k++) if (free[k] >= ids || index[free[k]] != Handles::NONE) return false;
+    return true;
+}
+
+// everything the scene indexes with or switches on: modes, groups, pools, spring ends, handles, tree links and the
+// sweep and prune state
+inline bool checkpointContentsValid(const char* in, const CheckpointColumn* table, const CheckpointHeader& h) {
+    const uint64_t bodies = table[CKPT_X].count, springs = table[CKPT_SPRING_A].count;
+    if (h.broadphase < 0 || h.broadphase >= BROADPHASE_COUNT || h.solver < 0 || h.solver >= SOLVER_COUNT ||
+        h.integrator < 0 || h.integrator >= INTEGRATOR_COUNT) return false;
+    if (!(h.step > 0) || !std::isfinite(h.step) || h.max_steps < 0 || !(h.grid_cell_size >= 0) || !std::isfinite(h.grid_cell_size))
+        return false;
+    const int8_t* group = checkpointData<int8_t>(in, table, CKPT_GROUP);
+    for (uint64_t i = 0; i < bodies; i++) if (group[i] < 0 || group[i] >= GROUP_COUNT) return false;
+    if (h.pool[0] != 0 || h.pool[SHAPE_COUNT] != bodies) return false;
+    const int8_t* shape = checkpointData<int8_t>(in, table, CKPT_SHAPE);
+    for (int t = 0; t < SHAPE_COUNT; t++) {
+        if (h.pool[t] > h.pool[t + 1]) return false;
+        for (uint32_t i = h.pool[t]; i < h.pool[t + 1]; i++) if (shape[i] != t) return false;
+    }
+    // a NaN or a box turned inside out would leave max endpoints sorted before their min endpoints
+    for (int k = CKPT_X; k <= CKPT_REST_TIME; k++) {
+        const float* v = checkpointData<float>(in, table, k);
+        for (uint64_t i = 0; i < bodies; i++) if (!std::isfinite(v[i]) || ((k == CKPT_HALF_W || k == CKPT_HALF_H) && v[i] < 0)) return false;
+    }
+    const uint32_t* a = checkpointData<uint32_t>(in, table, CKPT_SPRING_A), * b = checkpointData<uint32_t>(in, table, CKPT_SPRING_B);
+    for (uint64_t i = 0; i < springs; i++) if (a[i] >= bodies || b[i] >= bodies) return false;
+    for (int k = 0; k < 2; k++) {
+        const int index = k ? CKPT_SPRING_INDEX : CKPT_BODY_INDEX, handle = k ? CKPT_SPRING_HANDLE : CKPT_BODY_HANDLE;
+        const int free = k ? CKPT_SPRING_FREE : CKPT_BODY_FREE;
+        if (!checkpointHandlesValid(checkpointData<uint32_t>(in, table, index), table[index].count, checkpointData<uint32_t>(in, table, handle),
+                                    k ? springs : bodies, checkpointData<uint32_t>(in, table, free), table[free].count)) return false;
+    }
+
+    // the tree: a walk from the root reaches every node at most once with matching parent links, and reaches exactly
+    // the leaves body_leaf names. Every other node is on the free list; findPairs takes any node of positive height for
+    // an internal one, so heights have to match too
+    typedef AABBTree::Node Node;
+    const int NONE = AABBTree::NONE;
+    const Node* nodes = checkpointData<Node>(in, table, CKPT_TREE_NODES);
+    const int* body_leaf = checkpointData<int>(in, table, CKPT_TREE_BODY_LEAF);
+    const int64_t node_count = table[CKPT_TREE_NODES].count, leaves = table[CKPT_TREE_BODY_LEAF].count;
+    auto node = [&](int64_t i) {return i >= 0 && i < node_count;};
+    if ((h.tree_root != NONE && (!node(h.tree_root) || nodes[h.tree_root].parent != NONE)) ||
+        (h.tree_free_list != NONE && !node(h.tree_free_list))) return false;
+    int64_t leaf_count = 0;
+    for (int64_t i = 0; i < leaves; i++) {
+        if (body_leaf[i] == NONE) continue;
+        if (i >= (int64_t)bodies || !node(body_leaf[i]) || !nodes[body_leaf[i]].isLeaf() || nodes[body_leaf[i]].body != i) return false;
+        leaf_count++;
+    }
+    std::vector<int> stack;
+    if (h.tree_root != NONE) stack.push_back(h.tree_root);
+    int64_t visited = 0;
+    for (; !stack.empty(); visited++) {
+        const int i = stack.back();
+        stack.pop_back();
+        if (visited >= node_count) return false;
+        const Node& n = nodes[i];
+        if (n.isLeaf()) {
+            if (n.height != 0 || n.body < 0 || n.body >= leaves || body_leaf[n.body] != i) return false;
+            leaf_count--;
+            continue;
+        }
+        if (n.height <= 0 || !node(n.child1) || !node(n.child2) || nodes[n.child1].parent != i || nodes[n.child2].parent != i) return false;
+        stack.push_back(n.child1); stack.push_back(n.child2);
+    }
+    if (leaf_count != 0) return false;
+    for (int i = h.tree_free_list; i != NONE; i = nodes[i].parent)
+        if (!node(i) || nodes[i].height != -1 || ++visited > node_count) return false;
+    if (visited != node_count) return false;
+
+    // sweep and prune only keeps its state for sap_bodies > 0, after a reset it rebuilds from scratch
+    if (h.sap_bodies == 0) return true;
+    typedef SweepAndPrune::Endpoint Endpoint;
+    if (h.sap_bodies > bodies) return false;
+    std::vector<uint8_t> seen;
+    for (int k = 0; k < 2; k++) {
+        const int id = k ? CKPT_SAP_AXIS_Y : CKPT_SAP_AXIS_X;
+        const Endpoint* axis = checkpointData<Endpoint>(in, table, id);
+        if (table[id].count != 2*(uint64_t)h.sap_bodies) return false;
+        // every body exactly once as a min and once as a max endpoint
+        seen.assign(h.sap_bodies, 0);
+        for (uint64_t i = 0; i < 2*(uint64_t)h.sap_bodies; i++) {
+            if (axis[i].id() >= h.sap_bodies || seen[axis[i].id()] & (axis[i].isMax() ? 2 : 1)) return false;
+            seen[axis[i].id()] |= axis[i].isMax() ? 2 : 1;
+        }
+    }
+    const BodyPair* pairs = checkpointData<BodyPair>(in, table, CKPT_SAP_PAIRS);
+    const uint64_t pair_count = table[CKPT_SAP_PAIRS].count, slots = table[CKPT_SAP_TABLE].count;
+    for (uint64_t i = 0; i < pair_count; i++) if (pairs[i].a >= h.sap_bodies || pairs[i].b >= h.sap_bodies) return false;
+    // the hash table is probed with a mask, and every probe has to end on an empty slot
+    if (slots & (slots - 1) || slots <= pair_count) return false;
+    const uint32_t* hash = checkpointData<uint32_t>(in, table, CKPT_SAP_TABLE);
+    for (uint64_t i = 0; i < slots; i++) if (hash[i] != SweepAndPrune::EMPTY && hash[i] >= pair_count) return false;
+    return true;
+}
+
+// leaves the scene untouched and returns false unless the whole file checks out
+inline bool loadCheckpoint(Scene& scene, const char* path) {
+    MappedFile file;
+    if (!file.open(path) || file.size < sizeof(CheckpointHeader)) return false;
+    const char* in = (const char*)file.data;
+    CheckpointHeader h;
+    memcpy(&h, in, sizeof(h));
+    const uint32_t columns = CKPT_COLUMN_COUNT;
+    if (memcmp(h.magic, "PHYSCKPT", 8) || h.version != CHECKPOINT_VERSION || h.byte_order != 0x01020304 ||
+        h.header_size != sizeof(h) || h.column_count != columns || h.file_size != file.size) return false;
+    if (sizeof(h) + columns*sizeof(CheckpointColumn) > file.size) return false;
+    const CheckpointColumn* table = (const CheckpointColumn*)(in + sizeof(h));
+    bool ok = true;
+    checkpointColumns(scene, [&](int id, auto& column) {
+        const CheckpointColumn& c = table[id];
+        ok = ok && c.element_size == sizeof(column[0]) && c.offset%64 == 0 && c.offset <= file.size &&
+             c.count <= (file.size - c.offset)/sizeof(column[0]);
+    });
+    const uint64_t bodies = table[CKPT_X].count, springs = table[CKPT_SPRING_A].count;
+    for (int k = CKPT_X; k <= CKPT_FLAGS; k++) ok = ok && table[k].count == bodies;
+    for (int k = CKPT_SPRING_A; k <= CKPT_REST_LENGTH; k++) ok = ok && table[k].count == springs;
+    ok = ok && table[CKPT_BODY_HANDLE].count == bodies && table[CKPT_SPRING_HANDLE].count == springs;
+    ok = ok && table[CKPT_BODY_GENERATION].count == table[CKPT_BODY_INDEX].count;
+    ok = ok && table[CKPT_SPRING_GENERATION].count == table[CKPT_SPRING_INDEX].count;
+    if (!ok || !checkpointContentsValid(in, table, h)) return false;
+
+    checkpointColumns(scene, [&](int id, auto& column) {
+        typedef typename std::remove_reference<decltype(column[0])>::type T;
+        const CheckpointColumn& c = table[id];
+        const T* begin = (const T*)(in + c.offset);
+        column.assign(begin, begin + c.count);
+    });
+    scene.rng.state = h.rng_state; scene.steps = h.steps;
+    for (int k = 0; k <= SHAPE_COUNT; k++) scene.bodies.pool[k] = h.pool[k];
+    scene.gravity = sf::Vector2f(h.gravity_x, h.gravity_y); scene.air_resistance = h.air_resistance;
+    scene.step = h.step; scene.accumulator = h.accumulator; scene.alpha = h.alpha; scene.max_steps = h.max_steps;
+    scene.broadphase = (BroadphaseMode)h.broadphase; scene.solver = (Solver)h.solver;
+    scene.integrator = (Integrator)h.integrator; scene.staggered = h.staggered;
+    scene.allow_sleep = h.allow_sleep; scene.islands.sleeping = h.sleeping; scene.morton.interval = h.morton_interval;
+    scene.xpbd.iterations = h.xpbd_iterations;
+    scene.islands.sleep_speed = h.sleep_speed; scene.islands.time_to_sleep = h.time_to_sleep;
+    scene.xpbd.relaxation = h.relaxation; scene.xpbd.restitution = h.restitution; scene.grid.cell_size = h.grid_cell_size;
+    scene.tree.root = h.tree_root; scene.tree.free_list = h.tree_free_list; scene.sap.bodies = h.sap_bodies;
+    scene.springs.relink();
+    scene.springs.dirty = true;
+    return true;
+}
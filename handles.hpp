@@ -0,0 +1,30 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+// Generational handles into a compacted structure of arrays. The owner keeps its columns dense and moves the last
+// element into the gap of a removed one; index maps a handle to the current slot and handle maps a slot back, so a
+// handle survives every move. Removing an element bumps the generation of its handle and puts the handle up for reuse,
+// so an old copy of it no longer matches and reads as invalid instead of silently naming whatever comes next.
+struct Handles {
+    static constexpr uint32_t NONE = ~0u;
+    std::vector<uint32_t> index, generation; // per handle
+    std::vector<uint32_t> handle; // per slot, pushed and popped by the owner along with its columns
+    std::vector<uint32_t> free; // removed handles, handed out again before new ones
+
+    uint32_t create(uint32_t slot) {
+        uint32_t id;
+        if (free.empty()) {id = index.size(); index.push_back(NONE); generation.push_back(0);}
+        else {id = free.back(); free.pop_back();}
+        index[id] = slot; handle[slot] = id;
+        return id;
+    }
+    void destroy(uint32_t slot) {
+        const uint32_t id = handle[slot];
+        index[id] = NONE; generation[id]++;
+        free.push_back(id);
+    }
+    void move(uint32_t from, uint32_t to) {handle[to] = handle[from]; index[handle[to]] = to;}
+    bool valid(uint32_t id, uint32_t generation) const {return id < index.size() && this->generation[id] == generation;}
+    void reserve(uint32_t n) {index.reserve(n); generation.reserve(n); handle.reserve(n); free.reserve(n);}
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+enum Integrator {INTEGRATOR_EULER, INTEGRATOR_VERLET, INTEGRATOR_VELOCITY_VERLET, INTEGRATOR_LEAPFROG, INTEGRATOR_YOSHIDA,
+                 INTEGRATOR_COUNT};
+const char* const integrator_names[] = {"semi-implicit euler", "position verlet", "velocity verlet", "leapfrog", "yoshida 4"};
+
+// Integrators as compile time policies for Scene::integrateWith. Every one is a fixed sequence of passes over the
+// whole body array, S::pass(kick, drift, save) adding acceleration*kick to the velocity and then velocity*drift to the
+// position of every moving body in one loop, and of force evaluations S::evaluate() in between that recompute the
+// accelerations (springs, gravity, air resistance) at the current state. Collisions run once per step afterwards.
+// The cost of a step is its number of evaluations: one for all but Yoshida, which takes three for fourth order.
+
+// the original step: kick with the forces from the end of the last step, then drift; first order
+struct SemiImplicitEuler {
+    template <class S> static void step(S& s, float dt) {s.pass(dt, dt, true); s.evaluate();}
+};
+
+// Stoermer-Verlet in position form: drift half a step, evaluate at the midpoint, kick, drift the other half
+struct PositionVerlet {
+    template <class S> static void step(S& s, float dt) {
+        s.pass(0, dt/2, true);
+        s.evaluate();
+        s.pass(dt, dt/2, false);
+    }
+};
+
+// Stoermer-Verlet in velocity form: half kick with the forces from the end of the last step, drift, evaluate and kick
+// the other half, so positions and velocities are both reported at the end of the step
+struct VelocityVerlet {
+    template <class S> static void step(S& s, float dt) {
+        s.pass(dt/2, dt, true);
+        s.evaluate();
+        s.pass(dt/2, 0, false);
+    }
+};
+
+// Staggered leapfrog: velocities live half a step behind the positions. The first step only kicks by half a step to
+// move them there, Scene::integrate kicks the other half back when another integrator takes over. After the start this
+// is the same arithmetic as semi-implicit Euler, whose velocities are really half step ones too; the half kick is what
+// makes the trajectory second order in the initial state.
+struct Leapfrog {
+    template <class S> static void step(S& s, float dt) {
+        s.pass(s.staggered ? dt : dt/2, dt, true);
+        s.staggered = true;
+        s.evaluate();
+    }
+};
+
+// Yoshida's fourth order composition of three position Verlet steps of w1, w0 and w1 times dt
+struct Yoshida4 {
+    template <class S> static void step(S& s, float dt) {
+        const double cbrt2 = 1.2599210498948732, w1 = 1/(2 - cbrt2), w0 = -cbrt2/(2 - cbrt2);
+        const float c1 = w1/2*dt, c2 = (w0 + w1)/2*dt, d1 = w1*dt, d2 = w0*dt;
+        s.pass(0, c1, true);
+        s.evaluate(); s.pass(d1, c2, false);
+        s.evaluate(); s.pass(d2, c2, false);
+        s.evaluate(); s.pass(d1, c1, false);
+    }
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <vector>
+#include <numeric>
+#include "bodies.hpp"
+#include "springs.hpp"
+#include "broadphase.hpp"
+
+// Islands are the groups of moving bodies connected by springs or by broadphase pairs, built from scratch every step
+// with a union-find. Static bodies join nothing, so a pile on the floor splits into the heaps that actually touch.
+// A body's rest_time grows while the mean squared speed of its island stays below sleep_speed^2 and drops to 0
+// otherwise; once every body of an island has rested for time_to_sleep the whole island is put to sleep together.
+// Sleeping bodies keep their place in the broadphase but are skipped by the integrator, by springs between two of
+// them and by the narrowphase for every pair without an awake body. An island holding both sleeping and awake bodies
+// (an awake body touched it, or Body::wake was called on one of its bodies) is woken as a whole. Once everything is
+// asleep Scene::update skips the step altogether, so a scene that has come to rest costs a scan of the flags.
+//
+// Nothing notices a support being pulled away from under a sleeping island, it only wakes once something touches it.
+struct Islands {
+    float sleep_speed = 4.f, time_to_sleep = 0.5f;
+    std::vector<uint32_t> parent;
+    // per island root: summed squared speed, bodies, sleeping bodies and shortest rest_time
+    std::vector<float> speed2, min_rest;
+    std::vector<uint32_t> count, sleepers;
+    uint32_t sleeping = 0; // bodies asleep after the last update
+
+    uint32_t find(uint32_t i) {
+        while (parent[i] != i) {parent[i] = parent[parent[i]]; i = parent[i];}
+        return i;
+    }
+    // the smaller slot becomes the root, so the islands do not depend on the order of the unions
+    void unite(uint32_t a, uint32_t b) {
+        a = find(a); b = find(b);
+        if (a < b) parent[b] = a;
+        else if (b < a) parent[a] = b;
+    }
+
+    // true while bodies sleep and every body that could move is one of them; then nothing can touch or wake anything
+    bool resting(const Bodies& s) const {
+        if (!sleeping) return false;
+        for (uint32_t i = 0; i < s.size(); i++) if (!(s.flags[i] & (STATIC | SLEEPING))) return false;
+        return true;
+    }
+    void wakeAll(Bodies& s) {
+        for (uint32_t i = 0; i < s.size(); i++) {s.flags[i] &= ~SLEEPING; s.rest_time[i] = 0;}
+        sleeping = 0;
+    }
+
+    void update(Bodies& s, const Springs& springs, const std::vector<BodyPair>& pairs, float dt) {
+        const uint32_t n = s.size();
+        parent.resize(n);
+        std::iota(parent.begin(), parent.end(), 0u);
+        const uint8_t* flags = s.flags.data();
+        for (uint32_t i = 0; i < springs.size(); i++)
+            if (!((flags[springs.a[i]] | flags[springs.b[i]]) & STATIC)) unite(springs.a[i], springs.b[i]);
+        for (uint32_t i = 0; i < pairs.size(); i++)
+            if (!((flags[pairs[i].a] | flags[pairs[i].b]) & STATIC)) unite(pairs[i].a, pairs[i].b);
+
+        speed2.assign(n, 0); min_rest.assign(n, INFINITY); count.assign(n, 0); sleepers.assign(n, 0);
+        for (uint32_t i = 0; i < n; i++) {
+            if (flags[i] & STATIC) continue;
+            const uint32_t root = parent[i] = find(i);
+            speed2[root] += s.vx[i]*s.vx[i] + s.vy[i]*s.vy[i];
+            count[root]++;
+            sleepers[root] += (flags[i] & SLEEPING) != 0;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            if (flags[i] & STATIC) continue;
+            const uint32_t root = parent[i];
+            if (sleepers[root] == count[root]) continue;
+            if (sleepers[root]) {s.flags[i] &= ~SLEEPING; s.rest_time[i] = 0;}
+            else s.rest_time[i] = speed2[root] < sleep_speed*sleep_speed*count[root] ? s.rest_time[i] + dt : 0;
+            min_rest[root] = std::min(min_rest[root], s.rest_time[i]);
+        }
+        sleeping = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if (flags[i] & STATIC) continue;
+            const uint32_t root = parent[i];
+            if (sleepers[root] == count[root]) {sleeping++; continue;}
+            if (min_rest[root] < time_to_sleep) continue;
+            s.flags[i] |= SLEEPING; sleeping++;
+            s.vx[i] = s.vy[i] = 0;
+            s.x_old[i] = s.x[i]; s.y_old[i] = s.y[i];
+        }
+    }
+};
@@ -4,183 +4,74 @@
 #include <vector>
 #include <iostream>
 #include<math.h>
+#include "scenarios.hpp"
+#include "sim_thread.hpp"
+#include "batch_renderer.hpp"
+#include "checkpoint.hpp"
+#include "replay.hpp"
+#include "alloc_counter.hpp"
 
 #define PI 3.14159265358979323846f
 #define SUB_STEPS 8
 
 const std::vector<sf::Color> colors = {sf::Color::White, sf::Color::Red, sf::Color::Green, sf::Color::Blue};
-enum {CIRCLE, BOX, POLYGON};
 
-struct PObject {
-    PObject(float x, float y, float mass = 1.f, bool is_static = false, int8_t group = 0) {
-        this->position.x = x; this->position.y = y;
-		this->position_old = this->position;
-        this->is_static = is_static;
-        this->mass = mass;
-        this->group = rand()%4;
-        this->velocity.x = 0; this->velocity.y = 0;
-        this->acceleration.x = 0; this->acceleration.y = 0;
-        this->angularVelocity = 0; this->angularAcceleration = 0;
-    } // virtual ~PhysicalObject();
-    
-    sf::Vector2f position, position_old, velocity, acceleration;
-    float mass, rotation, angularVelocity, angularAcceleration;
-    bool is_static;
-    int8_t group;
-
-    virtual int getType() = 0;
-    virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const {}
-    void applyAcceleration(float x, float y) {acceleration.x += x; acceleration.y += y;}
-    void applyAcceleration(sf::Vector2f acceleration) {this->acceleration += acceleration;}
-    
-    void updateObject(float dt) {
-		if (!is_static) {
-			updatePosition(dt);
-			// updateRotation(dt);
-		}
+void draw(sf::RenderWindow& window, const Snapshot& s) {
+    // bodies are drawn alpha of the way from the previous step to the current one, see Scene::advance
+    auto px = [&](uint32_t i) {return s.x_old[i] + (s.x[i] - s.x_old[i])*s.alpha;};
+    auto py = [&](uint32_t i) {return s.y_old[i] + (s.y[i] - s.y_old[i])*s.alpha;};
+    static BatchRenderer renderer;
+    renderer.clear();
+    for (uint32_t i = s.begin(CIRCLE); i < s.end(CIRCLE); i++) renderer.addCircle(px(i), py(i), s.half_w[i], colors[s.group[i]]);
+    for (uint32_t i = s.begin(BOX); i < s.end(BOX); i++) renderer.addBox(px(i), py(i), s.half_w[i], s.half_h[i], colors[s.group[i]]);
+    renderer.resizeSprings(s.spring_a.size());
+    for (uint32_t i = 0; i < s.spring_a.size(); i++) {
+        const uint32_t a = s.spring_a[i], b = s.spring_b[i];
+        renderer.setSpring(i, sf::Vector2f(px(a), py(a)), sf::Vector2f(px(b), py(b)), colors[s.group[a]], colors[s.group[b]]);
     }
-    void updatePosition(float dt) {
-        if (is_static) return;
-		position_old = position;
-		velocity += acceleration*dt;
-	    position += velocity*dt;
-		acceleration = sf::Vector2f(0, 0);
-    }
-    void updateRotation(float dt) {
-        angularVelocity += angularAcceleration * dt; rotation += angularVelocity * dt;
-        if (rotation > 360) rotation -= 360; if (rotation < 0) rotation += 360;
-        angularAcceleration = 0;
-    }
-};
-
-struct PCircle : public PObject {
-    PCircle (float x, float y, float radius, float mass = 1.f, bool is_static = false, int8_t group = 0) :
-    PObject(x, y, mass, is_static, group) {this->radius = radius;}
-    float radius;
-    int getType() {return CIRCLE;}
-    void draw(sf::RenderTarget& target, sf::RenderStates states) const {
-        sf::CircleShape circle(radius);
-        circle.setOrigin(radius, radius);
-        circle.setPosition(position.x, position.y);
-        circle.setFillColor(colors[group]);
-        target.draw(circle, states);
-    }
-};
-
-struct PBox : public PObject {
-    PBox(float x, float y, float width, float height, float mass = 0.f, bool is_static = false, int8_t group = 0) :
-    PObject(x, y, mass, is_static, group) {this->width = width; this->height = height;}
-    float width, height;
-    int getType() {return BOX;}
-    void draw(sf::RenderTarget& target, sf::RenderStates states) const {
-        sf::RectangleShape box(sf::Vector2f(width, height));
-        box.setPosition(position.x, position.y);
-        box.setFillColor(colors[group]);
-        target.draw(box);
-    }
-};
-
-// struct PPolygon : public PObject {
-//     PPolygon(float x, float y, float radius, int sides, float mass = 0.f, bool is_static = false, int8_t group = 0) :
-//     PObject(x, y, mass, is_static, group) {
-//         this->radius = radius;
-//         this->sides = sides;
-//         this->angle = 2*PI/sides;
-//         this->vertices.resize(sides);
-//         for (int i = 0; i < sides; i++) {
-//             vertices[i].x = radius * cos(i*angle);
-//             vertices[i].y = radius * sin(i*angle);
-//         }
-//     }
-//     float radius, angle;
-//     int sides;
-//     std::vector<sf::Vector2f> vertices;
-//     void draw(sf::RenderTarget& target, sf::RenderStates states) const override {
-//         sf::ConvexShape polygon(sides);
-//         polygon.setPosition(position.x, position.y);
-//         polygon.setFillColor(colors[group]);
-//         polygon.setPoint(0, vertices[0]);
-//         for (int i = 1; i < sides; i++) polygon.setPoint(i, vertices[i]);
-//         target.draw(polygon);
-//     }
-// };
-
-struct Spring : sf::Drawable {
-    Spring(PObject* a, PObject* b, float spring_constant, float damping_constant) {
-        this->a = a; this->b = b;
-        this->spring_constant = spring_constant;
-        this->damping_constant = damping_constant;
-    }
-    PObject* a; PObject* b;
-    float spring_constant, damping_constant;
-
-    void draw(sf::RenderTarget& target, sf::RenderStates states = sf::RenderStates::Default) const {
-        sf::VertexArray line(sf::Lines, 2);
-        line[0].position = a->position; line[1].position = b->position;
-        line[0].color = colors[a->group]; line[1].color = colors[b->group];
-        target.draw(line, states);
-    }
-    
-    void updateSpring(float dt) {
-        sf::Vector2f delta = b->position - a->position;
-        float distance = sqrt(delta.x*delta.x + delta.y*delta.y);
-        float force = -spring_constant*distance;
-        sf::Vector2f force_vector = force*delta/distance;
-        a->applyAcceleration(-force_vector/a->mass);
-        b->applyAcceleration(force_vector/b->mass);
-    }
-};
-
-struct Scene {
-    Scene(sf::Vector2f gravity = sf::Vector2f(0, 0), float air_resistance = 0.f, bool elastic_collisions = true) {
-        this->gravity = gravity;
-        this->air_resistance = air_resistance;
-    }
-    std::vector<PObject*> objects;
-    std::vector<Spring*> springs;
-    sf::Vector2f gravity;
-    float air_resistance;
-    
-    void CollisionHandler() {
-        for (int i = 0; i < objects.size(); i++) for (int j = i+1; j < objects.size(); j++) {
-                // if (objects[i]->group != objects[j]->group) {
-                    if (objects[i]->getType() == CIRCLE && objects[j]->getType() == CIRCLE) CCTest((PCircle*)objects[i], (PCircle*)objects[j]);
-                    // else if (objects[i]->getType() == CIRCLE && objects[j]->getType() == BOX) CBTest((PCircle*)objects[i], (PBox*)objects[j]);
-                    // else if (objects[i]->getType() == BOX && objects[j]->getType() == CIRCLE) CBTest((PCircle*)objects[j], (PBox*)objects[i]);
-                    // else if (objects[i]->getType() == BOX && objects[j]->getType() == BOX) BBTest((PBox*)objects[i], (PBox*)objects[j]);
-                // }
+    renderer.draw(window);
+}
+
+// Plays a recorded trajectory instead of simulating: Space pauses, Left/Right jump a second, Up/Down double or halve
+// the speed and the number keys seek to tenths of the recording.
+int replay(sf::RenderWindow& window, sf::Text& text, const char* path) {
+    TrajectoryPlayer player;
+    if (!player.open(path)) {std::cerr << "cannot replay " << path << "\n"; return 1;}
+    const float frames_per_second = 60*SUB_STEPS; // one frame per recorded step
+    sf::Clock clock;
+    double playhead = 0, speed = 1;
+    bool paused = false;
+    while (window.isOpen()) {
+        sf::Event event;
+        while (window.pollEvent(event)) {
+            if (event.type == sf::Event::Closed || (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape)) window.close();
+            if (event.type != sf::Event::KeyPressed) continue;
+            const sf::Keyboard::Key key = event.key.code;
+            if (key == sf::Keyboard::Space) paused = !paused;
+            if (key == sf::Keyboard::Left) playhead -= frames_per_second;
+            if (key == sf::Keyboard::Right) playhead += frames_per_second;
+            if (key == sf::Keyboard::Up) speed *= 2;
+            if (key == sf::Keyboard::Down) speed /= 2;
+            if (key >= sf::Keyboard::Num0 && key <= sf::Keyboard::Num9) playhead = (key - sf::Keyboard::Num0)*player.frames()/10.0;
         }
-    }
-
-    void CCTest(PCircle* a, PCircle* b) {
-        if (a->is_static && b->is_static) return;
-        float sqdist = pow(a->position.x - b->position.x, 2) + pow(a->position.y - b->position.y, 2);
-        if (sqdist < pow(a->radius + b->radius, 2)) elasticCollision(a, b, sqdist);
-    }
+        const float dt = clock.restart().asSeconds();
+        if (!paused) playhead += dt*frames_per_second*speed;
+        playhead = std::max(0.0, std::min(playhead, player.frames() ? player.frames() - 1.0 : 0.0));
+        const Snapshot* snapshot = player.show((uint64_t)playhead);
+        text.setString("FPS: " + std::to_string(1/dt) + "\nreplay: " + path
+                       + "\nframe: " + std::to_string((uint64_t)playhead) + " / " + std::to_string(player.frames())
+                       + "\nspeed: " + std::to_string(speed) + (paused ? " (paused)" : "")
+                       + (snapshot ? "\nstep: " + std::to_string(snapshot->steps) : "\ndecoding"));
 
-    void elasticCollision(PCircle* a, PCircle* b, float& sqdist) {
-        const sf::Vector2f posdiff = a->position - b->position, veldiff = a->velocity - b->velocity;
-        const float mass_sum = a->mass + b->mass, distance = sqrt(sqdist), dot = posdiff.x*veldiff.x + posdiff.y*veldiff.y;
-        const sf::Vector2f delta = posdiff/distance*(a->radius + b->radius - distance)*0.5f;
-        a->velocity -= 2*b->mass*dot*posdiff/(mass_sum*sqdist); b->velocity += 2*a->mass*dot*posdiff/(mass_sum*sqdist);
-        a->position += delta; b->position -= delta;
-    }
-
-    void update(float dt) {
-        for (int i = 0; i < objects.size(); i++) objects[i]->updateObject(dt);
-        for (int i = 0; i < springs.size(); i++) springs[i]->updateSpring(dt);
-        for (int i = 0; i < objects.size(); i++) objects[i]->applyAcceleration(gravity - air_resistance*objects[i]->velocity);
-        CollisionHandler();
-    }
-
-    void draw(sf::RenderWindow& window) {
-        for (int i = 0; i < objects.size(); i++) objects[i]->draw(window, sf::RenderStates::Default); // window.draw(*objects[i], sf::RenderStates::Default);
-        for (int i = 0; i < springs.size(); i++) window.draw(*springs[i]); //springs[i]->draw(&window);
+        window.clear();
+        if (snapshot) {PROFILE_SCOPE("draw"); draw(window, *snapshot);}
+        window.draw(text);
+        {PROFILE_SCOPE("display"); window.display();}
     }
-};
+    return 0;
+}
 
-int main() {
-    sf::Clock clock;
+int main(int argc, char** argv) {
     sf::ContextSettings settings; settings.antialiasingLevel = 8;
     sf::RenderWindow window(sf::VideoMode(1000, 1000), "pure chaos", sf::Style::None, settings);
     // window.setFramerateLimit(60); // window.setMouseCursorVisible(false);
@@ -188,35 +79,97 @@ int main() {
     sf::Font font; sf::Text text;
     font.loadFromFile("Lavinia.otf");
     text.setFont(font); text.setCharacterSize(20); text.setPosition(5, 5);
-    
-    Scene scene(sf::Vector2f(0, 0), 0.1f);
-    for (int i = 0; i < 15; i++) for (int j = 0; j < 15; j++) {
-		scene.objects.push_back(new PCircle(250 + i*30, 250 + j*30, 9, 250));
-		scene.objects.back()->velocity = sf::Vector2f(rand()%100 - 50, rand()%100 - 50);
-	}
-    // scene.objects.push_back(new PCircle(500.f, 10000.f, 10200.f, 10000.f, true));
 
-    for (int i = 0; i < 224; i++) if (i%15 != 14) scene.springs.push_back(new Spring(scene.objects[i], scene.objects[i+1], 1000, 0.1f));
-    for (int i = 0; i < 210; i++) scene.springs.push_back(new Spring(scene.objects[i], scene.objects[i+15], 1000, 0.1f));
+    if (argc == 3 && !strcmp(argv[1], "--replay")) return replay(window, text, argv[2]);
+
+    sf::Clock clock;
+    Scene scene(sf::Vector2f(0, 0), 0.1f);
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    scene.thread_pool.resize(cores);
+    scene.setTimestep(1.f/60, SUB_STEPS);
+    setupLattice(scene, 15*15);
+    // scene.addCircle(500.f, 10000.f, 10200.f, 10000.f, true);
+
+    // M moves the simulation onto its own thread and back; either way the window only draws published snapshots
+    SimThread sim(&scene);
+    Recorder recorder; // R starts and stops recording every step to run.traj
+    sim.publish();
+    float steps_per_second = 0, rate_time = 0;
+    uint64_t rate_steps = 0;
+    // the most any frame since the last overlay refresh allocated, on either thread. The overlay is formatted into a
+    // fixed buffer and copied character by character into an sf::String that is kept, so once its capacity and the
+    // text's vertices have grown to fit, a refresh frame does not allocate either
+    AllocationCount frame_start = AllocationCounter::now(), frame_allocations = {0, 0}, shown_allocations = {0, 0};
+    char overlay[512];
+    sf::String overlay_string;
 
     bool spacepressed = false;
     while (window.isOpen()) {
         sf::Event event;
-        while (window.pollEvent(event))
+        while (window.pollEvent(event)) {
             if (event.type == sf::Event::Closed || (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape)) window.close();
+            if (event.type != sf::Event::KeyPressed) continue;
+            if (event.key.code == sf::Keyboard::B) sim.post([](Scene& scene) {scene.broadphase = (BroadphaseMode)((scene.broadphase + 1)%BROADPHASE_COUNT);});
+            if (event.key.code == sf::Keyboard::N) sim.post([](Scene& scene) {
+                CircleBatches& batches = scene.circle_batches;
+                batches.level = (SimdLevel)((batches.level + 1)%(batches.supported + 1));
+            });
+            if (event.key.code == sf::Keyboard::T) sim.post([cores](Scene& scene) {scene.thread_pool.resize(scene.thread_pool.size() > 1 ? 1 : cores);});
+            if (event.key.code == sf::Keyboard::X) sim.post([](Scene& scene) {scene.solver = (Solver)((scene.solver + 1)%SOLVER_COUNT);});
+            if (event.key.code == sf::Keyboard::I) sim.post([](Scene& scene) {scene.integrator = (Integrator)((scene.integrator + 1)%INTEGRATOR_COUNT);});
+            if (event.key.code == sf::Keyboard::Z) sim.post([](Scene& scene) {scene.allow_sleep = !scene.allow_sleep;});
+            if (event.key.code == sf::Keyboard::O) sim.post([](Scene& scene) {scene.morton.interval = scene.morton.interval ? 0 : 240;});
+            if (event.key.code == sf::Keyboard::BackSpace) sim.post([](Scene& scene) { // despawn a random circle
+                const uint32_t circles = scene.bodies.end(CIRCLE) - scene.bodies.begin(CIRCLE);
+                if (circles) scene.removeBody(scene.bodyAt(scene.bodies.begin(CIRCLE) + scene.rng.next()%circles));
+            });
+            // F5 saves the scene to scene.ckpt and F9 puts it back, a file that does not load leaves the scene as it is
+            if (event.key.code == sf::Keyboard::F5) sim.post([](Scene& scene) {if (!saveCheckpoint(scene, "scene.ckpt")) std::cerr << "cannot save scene.ckpt\n";});
+            if (event.key.code == sf::Keyboard::F9) sim.post([](Scene& scene) {if (!loadCheckpoint(scene, "scene.ckpt")) std::cerr << "cannot load scene.ckpt\n";});
+            if (event.key.code == sf::Keyboard::R) sim.post([&recorder](Scene& scene) {
+                if (scene.recorder) {scene.recorder = nullptr; if (!recorder.close()) std::cerr << "cannot write run.traj\n";}
+                else if (recorder.open("run.traj")) scene.recorder = &recorder;
+                else std::cerr << "cannot record to run.traj\n";
+            });
+#ifdef PHYSICS_PROFILE
+            // P writes the trace scopes of every thread so far to trace.json
+            if (event.key.code == sf::Keyboard::P && !Profiler::instance().writeChromeTrace("trace.json")) std::cerr << "cannot write trace.json\n";
+#endif
+            if (event.key.code == sf::Keyboard::M) {if (sim.threaded()) sim.stop(); else sim.start();}
+        }
         if (sf::Keyboard::isKeyPressed(sf::Keyboard::Space) && !spacepressed) {
-            scene.objects.push_back(new PCircle(rand() % 1000, rand() % 1000, rand() % 100 + 10));
+            sim.post([](Scene& scene) {scene.addCircle(scene.rng.next() % 1000, scene.rng.next() % 1000, scene.rng.next() % 100 + 10);});
             spacepressed = true;
         } else if (!sf::Keyboard::isKeyPressed(sf::Keyboard::Space)) spacepressed = false;
 
         float dt = clock.restart().asSeconds();
-        scene.update(dt);
-        text.setString("FPS: " + std::to_string(1/dt));
+        if (!sim.threaded()) sim.tick(dt);
+        const Snapshot& snapshot = sim.snapshots.read();
+        rate_time += dt;
+        if (rate_time >= 0.5f) {
+            steps_per_second = (snapshot.steps - rate_steps)/rate_time;
+            rate_steps = snapshot.steps; rate_time = 0;
+            shown_allocations = frame_allocations; frame_allocations = {0, 0};
+            snprintf(overlay, sizeof(overlay), "FPS: %f\nsteps/s: %d\nsimulation: %s\nsolver: %s\nintegrator: %s\nbroadphase: %s"
+                     "\nnarrowphase: %s\nthreads: %u\nsleeping: %u\nallocations/frame: %llu (%llu bytes)%s", 1/dt, (int)steps_per_second,
+                     sim.threaded() ? "own thread" : "render thread", solver_names[snapshot.solver], integrator_names[snapshot.integrator],
+                     broadphase_names[snapshot.broadphase], snapshot.narrowphase < 0 ? "coloured" : simd_names[snapshot.narrowphase],
+                     (unsigned)snapshot.threads, (unsigned)snapshot.sleeping, (unsigned long long)shown_allocations.count,
+                     (unsigned long long)shown_allocations.bytes, recorder.recording() ? "\nrecording run.traj" :
+                     recorder.write_failed ? "\ncannot write run.traj" : "");
+            overlay_string.clear();
+            for (const char* c = overlay; *c; c++) overlay_string += sf::String((sf::Uint32)(unsigned char)*c);
+            text.setString(overlay_string);
+        }
 
         window.clear();
-        scene.draw(window);
+        {PROFILE_SCOPE("draw"); draw(window, snapshot);}
         window.draw(text);
-        window.display();
+        {PROFILE_SCOPE("display"); window.display();}
+        const AllocationCount now = AllocationCounter::now(), frame = now - frame_start;
+        if (frame.count > frame_allocations.count) frame_allocations = frame;
+        frame_start = now;
     }
+    sim.stop();
     return 0;
 }
\ No newline at end of file
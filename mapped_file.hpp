@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A whole file mapped into memory, read only through open() and read/write through create(), with POSIX mmap or a
+// Windows file mapping. Pages are only read in as they are touched, so a file much larger than memory can be mapped.
+struct MappedFile {
+    void* data = nullptr;
+    uint64_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE, mapping = nullptr;
+#endif
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() {close();}
+
+    bool open(const char* path) {return map(path, 0, false);}
+    bool create(const char* path, uint64_t size) {return map(path, size, true);}
+
+#ifdef _WIN32
+    bool map(const char* path, uint64_t new_size, bool write) {
+        close();
+        file = CreateFileA(path, write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, write ? 0 : FILE_SHARE_READ, nullptr,
+                           write ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER length;
+        if (write) length.QuadPart = new_size;
+        else if (!GetFileSizeEx(file, &length)) {close(); return false;}
+        size = length.QuadPart;
+        if (size == 0) return true;
+        mapping = CreateFileMappingA(file, nullptr, write ? PAGE_READWRITE : PAGE_READONLY, length.HighPart, length.LowPart, nullptr);
+        if (mapping) data = MapViewOfFile(mapping, write ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+        if (!data) {close(); return false;}
+        return true;
+    }
+    void close() {
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        data = nullptr; mapping = nullptr; file = INVALID_HANDLE_VALUE; size = 0;
+    }
+#else
+    bool map(const char* path, uint64_t new_size, bool write) {
+        close();
+        const int fd = write ? ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644) : ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        bool ok = write ? ftruncate(fd, new_size) == 0 : fstat(fd, &info) == 0;
+        size = write ? new_size : (ok ? info.st_size : 0);
+        if (ok && size) {
+            data = mmap(nullptr, size, write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED) {data = nullptr; ok = false;}
+        }
+        ::close(fd); // the mapping keeps the file
+        if (!ok) size = 0;
+        return ok;
+    }
+    void close() {
+        if (data) munmap(data, size);
+        data = nullptr; size = 0;
+    }
+#endif
+};
@@ -0,0 +1,330 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include "scene.hpp"
+#ifdef MICROBENCH_SFML
+#include "batch_renderer.hpp"
+#endif
+
+// Microbenchmarks of the hot kernels on their own, in the spirit of Google Benchmark. Every case is a kernel run over
+// a scene of the given body count, area density (share of the box covered by bodies) and radius distribution. Mutated
+// columns are put back between iterations outside the timed region, so every iteration does the same work. Iterations
+// are timed in batches of at least --min-sample seconds and a batch's time divided by its ops (pairs, springs or
+// bodies) is one sample. The cases take turns in --repetitions short rounds, so a busy spell of the machine hits some
+// rounds of every case rather than every round of one. Each case prints the median ns/op of its fastest round, the
+// spread (how far the fastest tenth of the rounds reaches above it) and the throughput, one JSON object per line.
+//
+// --baseline compares against a file written by an earlier run and exits with 2 when a case got slower by more than
+// --threshold, or by more than the spreads of both runs together where that is wider, so a noisy case has to move
+// further before it counts. A case that looks slower is measured again up to --retries times before it is reported.
+// Example: ./microbench --kernel cctest --bodies 1000,100000 --density 0.1,0.5 --baseline before.json
+// The stored baseline is microbench_baseline.json, a run of the default cases; make microbench_check compares against
+// it. Its times only mean something on the machine that wrote it, so rewrite it when that changes.
+// Building with MICROBENCH_SFML (make microbench_sfml) adds the draw kernel, which renders into an off-screen target.
+
+enum RadiusDistribution {RADIUS_EQUAL, RADIUS_UNIFORM, RADIUS_BIMODAL, RADIUS_COUNT};
+const char* const radius_names[] = {"equal", "uniform", "bimodal"};
+
+struct Fixture {
+    Scene scene;
+    std::vector<BodyPair> overlapping;
+    std::vector<float> x, y, x_old, y_old, vx, vy; // as set up, put back before every iteration
+
+    Fixture(uint32_t bodies, float density, RadiusDistribution radius, uint64_t seed) : scene(sf::Vector2f(0, 500), 0.1f) {
+        scene.rng = Rng(seed);
+        std::vector<float> radii(bodies);
+        float area = 0;
+        for (uint32_t i = 0; i < bodies; i++) {
+            if (radius == RADIUS_EQUAL) radii[i] = 6;
+            else if (radius == RADIUS_UNIFORM) radii[i] = scene.rng.range(4, 9);
+            else radii[i] = scene.rng.next()%10 ? 4.f : 16.f;
+            area += 3.14159265f*radii[i]*radii[i];
+        }
+        const float side = sqrt(area/density);
+        scene.reserve(bodies, 2*bodies);
+        for (uint32_t i = 0; i < bodies; i++) {
+            Body body = scene.addCircle(scene.rng.range(0, side), scene.rng.range(0, side), radii[i], 1 + scene.rng.next()%5);
+            body.setVelocity(sf::Vector2f(scene.rng.range(-30, 30), scene.rng.range(-30, 30)));
+        }
+        scene.findPairs();
+        const Bodies& s = scene.bodies;
+        for (const BodyPair& p : scene.pool_pairs[0]) {
+            const float dx = s.x[p.a] - s.x[p.b], dy = s.y[p.a] - s.y[p.b], r = s.half_w[p.a] + s.half_w[p.b];
+            if (dx*dx + dy*dy < r*r && dx*dx + dy*dy > 0) overlapping.push_back(p);
+        }
+        // a spring along every candidate pair, up to two per body
+        for (uint32_t i = 0; i < scene.pool_pairs[0].size() && scene.springs.size() < 2*bodies; i++) {
+            const BodyPair& p = scene.pool_pairs[0][i];
+            scene.springs.add(p.a, p.b, 1000, 0.1f, 20);
+        }
+        x = s.x; y = s.y; x_old = s.x_old; y_old = s.y_old; vx = s.vx; vy = s.vy;
+    }
+    void restore() {
+        Bodies& s = scene.bodies;
+        std::copy(x.begin(), x.end(), s.x.begin()); std::copy(y.begin(), y.end(), s.y.begin());
+        std::copy(x_old.begin(), x_old.end(), s.x_old.begin()); std::copy(y_old.begin(), y_old.end(), s.y_old.begin());
+        std::copy(vx.begin(), vx.end(), s.vx.begin()); std::copy(vy.begin(), vy.end(), s.vy.begin());
+    }
+};
+
+// one iteration of a kernel; returns the ops it did
+struct Kernel {
+    const char* name;
+    const char* op; // what an op is
+    uint64_t (*run)(Fixture& f);
+};
+
+static uint64_t runCCTest(Fixture& f) {
+    Bodies& s = f.scene.bodies;
+    const std::vector<BodyPair>& pairs = f.scene.pool_pairs[0];
+    for (uint32_t i = 0; i < pairs.size(); i++) CCTest(s, pairs[i].a, pairs[i].b);
+    return pairs.size();
+}
+static uint64_t runElastic(Fixture& f) {
+    Bodies& s = f.scene.bodies;
+    for (const BodyPair& p : f.overlapping) {
+        const float dx = s.x[p.a] - s.x[p.b], dy = s.y[p.a] - s.y[p.b];
+        elasticCollision(s, p.a, p.b, dx*dx + dy*dy);
+    }
+    return f.overlapping.size();
+}
+static uint64_t runSprings(Fixture& f) {
+    f.scene.clearAccelerations();
+    f.scene.springs.apply(f.scene.bodies, f.scene.thread_pool);
+    return f.scene.springs.size();
+}
+static uint64_t runIntegrate(Fixture& f) {
+    f.scene.clearAccelerations();
+    f.scene.applyForces();
+    f.scene.pass(1.f/480, 1.f/480, true);
+    return f.scene.bodies.size();
+}
+static uint64_t runGrid(Fixture& f) {
+    f.scene.grid.findPairs(f.scene.bounds, f.scene.pairs);
+    return f.scene.bodies.size();
+}
+#ifdef MICROBENCH_SFML
+static uint64_t runDraw(Fixture& f) {
+    static sf::RenderTexture target;
+    static BatchRenderer renderer;
+    if (target.getSize().x == 0) target.create(1000, 1000);
+    const Bodies& s = f.scene.bodies;
+    target.clear();
+    renderer.clear();
+    for (uint32_t i = s.begin(CIRCLE); i < s.end(CIRCLE); i++) renderer.addCircle(s.x[i], s.y[i], s.half_w[i], sf::Color::White);
+    renderer.resizeSprings(0);
+    renderer.draw(target);
+    target.display();
+    return s.size();
+}
+#endif
+
+const Kernel kernels[] = {
+    {"cctest", "pair", runCCTest},
+    {"elastic", "contact", runElastic},
+    {"springs", "spring", runSprings},
+    {"integrate", "body", runIntegrate},
+    {"grid", "body", runGrid},
+#ifdef MICROBENCH_SFML
+    {"draw", "body", runDraw},
+#endif
+};
+const int KERNEL_COUNT = sizeof(kernels)/sizeof(kernels[0]);
+
+struct Options {
+    std::string kernel = "all", baseline;
+    std::vector<uint32_t> bodies = {1000, 100000};
+    std::vector<float> densities = {0.1f, 0.5f};
+    std::vector<int> radii = {RADIUS_UNIFORM, RADIUS_BIMODAL};
+    double min_time = 0.01, min_sample = 0.001, threshold = 0.05;
+    uint32_t min_iterations = 10, repetitions = 20, retries = 4;
+    uint64_t seed = 1;
+};
+
+struct Result {std::string name; double ns_per_op, spread;};
+
+static void usage() {
+    fprintf(stderr, "usage: microbench [--kernel all|cctest|elastic|springs|integrate|grid|draw] [--bodies n,n..]\n"
+                    "                  [--density d,d..] [--radius equal|uniform|bimodal,..] [--min-time seconds]\n"
+                    "                  [--min-sample seconds] [--min-iterations n] [--repetitions n] [--seed n]\n"
+                    "                  [--baseline file] [--threshold fraction] [--retries n]\n");
+}
+
+template <class T, class F> static bool parseList(const char* value, std::vector<T>& out, const F& parse) {
+    out.clear();
+    std::string list = value;
+    for (size_t begin = 0, end; begin <= list.size(); begin = end + 1) {
+        end = list.find(',', begin);
+        if (end == std::string::npos) end = list.size();
+        T item;
+        if (!parse(list.substr(begin, end - begin), item)) return false;
+        out.push_back(item);
+    }
+    return !out.empty();
+}
+
+static bool parse(int argc, char** argv, Options& o) {
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) return false;
+        const char* key = argv[i], * value = argv[++i];
+        if (!strcmp(key, "--kernel")) o.kernel = value;
+        else if (!strcmp(key, "--bodies")) {
+            if (!parseList(value, o.bodies, [](const std::string& s, uint32_t& v) {v = strtoul(s.c_str(), nullptr, 10); return v > 0;})) return false;
+        } else if (!strcmp(key, "--density")) {
+            if (!parseList(value, o.densities, [](const std::string& s, float& v) {v = strtof(s.c_str(), nullptr); return v > 0;})) return false;
+        } else if (!strcmp(key, "--radius")) {
+            auto radius = [](const std::string& s, int& v) {
+                for (v = 0; v < RADIUS_COUNT; v++) if (s == radius_names[v]) return true;
+                return false;
+            };
+            if (!parseList(value, o.radii, radius)) return false;
+        }
+        else if (!strcmp(key, "--min-time")) o.min_time = strtod(value, nullptr);
+        else if (!strcmp(key, "--retries")) o.retries = strtoul(value, nullptr, 10);
+        else if (!strcmp(key, "--repetitions")) o.repetitions = std::max(1ul, strtoul(value, nullptr, 10));
+        else if (!strcmp(key, "--min-sample")) o.min_sample = strtod(value, nullptr);
+        else if (!strcmp(key, "--min-iterations")) o.min_iterations = strtoul(value, nullptr, 10);
+        else if (!strcmp(key, "--seed")) o.seed = strtoull(value, nullptr, 10);
+        else if (!strcmp(key, "--baseline")) o.baseline = value;
+        else if (!strcmp(key, "--threshold")) o.threshold = strtod(value, nullptr);
+        else return false;
+    }
+    return true;
+}
+
+// the name, ns_per_op and spread of every line this program printed before
+static std::vector<Result> readBaseline(const char* path) {
+    std::vector<Result> results;
+    FILE* file = fopen(path, "r");
+    if (!file) return results;
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        const char* name = strstr(line, "\"name\": \""), * ns = strstr(line, "\"ns_per_op\": "), * spread = strstr(line, "\"spread\": ");
+        if (!name || !ns) continue;
+        name += strlen("\"name\": \"");
+        const char* end = strchr(name, '"');
+        if (end) results.push_back({std::string(name, end), strtod(ns + strlen("\"ns_per_op\": "), nullptr),
+                                    spread ? strtod(spread + strlen("\"spread\": "), nullptr) : 0});
+    }
+    fclose(file);
+    return results;
+}
+
+// one kernel on one fixture, measured a round at a time
+struct Case {
+    char name[256];
+    Fixture* fixture;
+    const Kernel* kernel;
+    std::vector<double> rounds; // median ns/op of each round
+    double min = 1e300, seconds = 0;
+    uint64_t ops = 0, iterations = 0;
+
+    // the fastest round, and how far the fastest tenth of the rounds reaches above it
+    double best() const {return *std::min_element(rounds.begin(), rounds.end());}
+    double spread() const {
+        std::vector<double> sorted = rounds;
+        std::sort(sorted.begin(), sorted.end());
+        return sorted[0] > 0 ? sorted[sorted.size()/10]/sorted[0] - 1 : 0;
+    }
+};
+
+static void measureRound(Case& c, const Options& o, std::vector<double>& samples) {
+    typedef std::chrono::steady_clock Clock;
+    Fixture& fixture = *c.fixture;
+    fixture.restore();
+    c.kernel->run(fixture); // warm up caches and lazily built state
+    samples.clear();
+    double seconds = 0;
+    while (seconds < o.min_time || samples.size() < o.min_iterations) {
+        double batch = 0;
+        uint64_t batch_ops = 0;
+        while (batch < o.min_sample || !batch_ops) {
+            fixture.restore();
+            const Clock::time_point start = Clock::now();
+            const uint64_t n = c.kernel->run(fixture);
+            batch += std::chrono::duration<double>(Clock::now() - start).count();
+            c.iterations++;
+            if (!n) break;
+            batch_ops += n;
+        }
+        seconds += batch; c.ops += batch_ops;
+        samples.push_back(batch_ops ? batch*1e9/batch_ops : 0);
+        if (samples.size() >= 1000000) break;
+    }
+    std::sort(samples.begin(), samples.end());
+    c.rounds.push_back(samples[samples.size()/2]);
+    c.min = std::min(c.min, samples.front());
+    c.seconds += seconds;
+}
+
+int main(int argc, char** argv) {
+    Options o;
+    if (!parse(argc, argv, o)) {usage(); return 1;}
+    std::vector<Result> baseline;
+    if (!o.baseline.empty()) {
+        baseline = readBaseline(o.baseline.c_str());
+        if (baseline.empty()) {fprintf(stderr, "no results in %s\n", o.baseline.c_str()); return 1;}
+    }
+    std::vector<const Kernel*> selected;
+    for (int k = 0; k < KERNEL_COUNT; k++) if (o.kernel == "all" || o.kernel == kernels[k].name) selected.push_back(&kernels[k]);
+    if (selected.empty()) {usage(); return 1;}
+
+    std::vector<std::unique_ptr<Fixture>> fixtures;
+    std::vector<Case> cases;
+    for (uint32_t bodies : o.bodies) for (float density : o.densities) for (int radius : o.radii) {
+        fixtures.emplace_back(new Fixture(bodies, density, (RadiusDistribution)radius, o.seed));
+        for (const Kernel* kernel : selected) {
+            cases.emplace_back();
+            Case& c = cases.back();
+            snprintf(c.name, sizeof(c.name), "%s/bodies:%u/density:%g/radius:%s", kernel->name, bodies, density, radius_names[radius]);
+            c.fixture = fixtures.back().get(); c.kernel = kernel;
+        }
+    }
+
+    std::vector<double> samples;
+    for (uint32_t round = 0; round < o.repetitions; round++) for (Case& c : cases) measureRound(c, o, samples);
+
+    // a case that looks slower gets more rounds before it counts, a little later each time: on a shared machine a busy
+    // neighbour can slow every round of a case for seconds
+    std::vector<double> change(cases.size(), 0), allowed(cases.size(), 0);
+    std::vector<const Result*> before(cases.size(), nullptr);
+    for (uint32_t i = 0; i < cases.size(); i++) for (const Result& r : baseline) if (r.name == cases[i].name) before[i] = &r;
+    for (uint32_t retry = 0; retry <= o.retries; retry++) {
+        bool slower = false;
+        for (uint32_t i = 0; i < cases.size(); i++) {
+            if (!before[i]) continue;
+            const Case& c = cases[i];
+            change[i] = before[i]->ns_per_op > 0 ? c.best()/before[i]->ns_per_op - 1 : 0;
+            allowed[i] = std::max(o.threshold, c.spread() + before[i]->spread);
+            if (change[i] <= allowed[i]) continue;
+            slower = true;
+            if (retry < o.retries) for (uint32_t round = 0; round < o.repetitions; round++) measureRound(cases[i], o, samples);
+        }
+        if (!slower || retry == o.retries) break;
+        std::this_thread::sleep_for(std::chrono::seconds(retry + 1));
+    }
+
+    uint32_t regressions = 0;
+    printf("[\n");
+    for (uint32_t i = 0; i < cases.size(); i++) {
+        const Case& c = cases[i];
+        printf("%s  {\"name\": \"%s\", \"ns_per_op\": %.4f, \"spread\": %.4f, \"worst_round_ns\": %.4f, \"min_ns\": %.4f, "
+               "\"ops_per_sec\": %.1f, \"op\": \"%s\", \"ops_per_iteration\": %.1f, \"iterations\": %llu, \"rounds\": %zu",
+               i ? ",\n" : "", c.name, c.best(), c.spread(), *std::max_element(c.rounds.begin(), c.rounds.end()), c.min,
+               c.seconds > 0 ? c.ops/c.seconds : 0.0, c.kernel->op, c.iterations ? (double)c.ops/c.iterations : 0.0,
+               (unsigned long long)c.iterations, c.rounds.size());
+        if (before[i]) {
+            printf(", \"baseline_ns_per_op\": %.4f, \"change\": %.4f, \"allowed\": %.4f", before[i]->ns_per_op, change[i], allowed[i]);
+            if (change[i] > allowed[i]) {fprintf(stderr, "slower: %s %+.1f%% (allowed %+.1f%%)\n", c.name, change[i]*100, allowed[i]*100); regressions++;}
+        }
+        printf("}");
+    }
+    printf("\n]\n");
+    return regressions ? 2 : 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "bodies.hpp"
+#include "radix_sort.hpp"
+
+// Z-order curve: the bits of the two 16 bit cell coordinates interleaved, so cells close in space mostly get close codes
+inline uint32_t spreadBits(uint32_t v) {
+    v &= 0xffff;
+    v = (v | v << 8) & 0x00ff00ffu; v = (v | v << 4) & 0x0f0f0f0fu;
+    v = (v | v << 2) & 0x33333333u; v = (v | v << 1) & 0x55555555u;
+    return v;
+}
+inline uint32_t morton(uint32_t x, uint32_t y) {return spreadBits(x) | spreadBits(y) << 1;}
+
+// Spatial re-sort of the bodies every interval steps. Each shape pool is sorted by the Morton code of the body's cell
+// on a 65536 x 65536 grid over the scene bounds, so bodies close in space end up close in the arrays and the
+// broadphase, the narrowphase and the springs walk memory mostly in order again after the scene has mixed. build only
+// works out the permutation: order[new slot] = old slot and new_slot[old slot] = new slot; Scene::reorder applies it
+// to the columns and to everything holding slots.
+struct MortonOrder {
+    int interval = 0; // steps between reorders, 0 turns it off
+    std::vector<uint32_t> keys, order, new_slot;
+    RadixSort radix;
+
+    void build(const Bodies& s, ThreadPool& pool) {
+        const uint32_t n = s.size();
+        float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+        for (uint32_t i = 0; i < n; i++) {
+            min_x = std::min(min_x, s.x[i]); max_x = std::max(max_x, s.x[i]);
+            min_y = std::min(min_y, s.y[i]); max_y = std::max(max_y, s.y[i]);
+        }
+        const float extent = std::max(max_x - min_x, max_y - min_y), scale = extent > 0 ? 65535/extent : 0;
+        keys.resize(n); order.resize(n); new_slot.resize(n);
+        pool.parallelFor(n, 8192, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                keys[i] = morton((uint32_t)((s.x[i] - min_x)*scale), (uint32_t)((s.y[i] - min_y)*scale));
+                order[i] = i;
+            }
+        });
+        for (int t = 0; t < SHAPE_COUNT; t++) radix.sort(keys.data() + s.begin(t), order.data() + s.begin(t), s.end(t) - s.begin(t), pool);
+        pool.parallelFor(n, 8192, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) new_slot[order[i]] = i;
+        });
+    }
+};
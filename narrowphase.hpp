@@ -0,0 +1,122 @@
+#pragma once
+#include "bodies.hpp"
+#include "broadphase.hpp"
+
+// Pair tests for every combination of shapes. PairTest<A, B> resolves the shape pair at compile time, so the loops in
+// Scene::CollisionHandler run over one pool pair at a time without any per-pair type checks.
+
+// the overlap is split evenly between two moving bodies, a static body is never pushed
+inline void separate(Bodies& s, uint32_t a, uint32_t b, float nx, float ny, float depth) {
+    const float share_a = s.inv_mass[a] == 0 ? 0.f : (s.inv_mass[b] == 0 ? 1.f : 0.5f);
+    const float share_b = s.inv_mass[b] == 0 ? 0.f : (s.inv_mass[a] == 0 ? 1.f : 0.5f);
+    s.x[a] += share_a*depth*nx; s.y[a] += share_a*depth*ny;
+    s.x[b] -= share_b*depth*nx; s.y[b] -= share_b*depth*ny;
+}
+
+// elastic exchange along the unit normal n pointing from b to a, only while the bodies approach each other
+inline void bounce(Bodies& s, uint32_t a, uint32_t b, float nx, float ny) {
+    const float inv_a = s.inv_mass[a], inv_b = s.inv_mass[b];
+    const float vn = (s.vx[a] - s.vx[b])*nx + (s.vy[a] - s.vy[b])*ny;
+    if (vn >= 0) return;
+    const float impulse = -2*vn/(inv_a + inv_b);
+    s.vx[a] += impulse*inv_a*nx; s.vy[a] += impulse*inv_a*ny;
+    s.vx[b] -= impulse*inv_b*nx; s.vy[b] -= impulse*inv_b*ny;
+}
+
+// the velocity exchange splits by mass (mass_b/mass_sum == inv_a/inv_sum)
+inline void elasticCollision(Bodies& s, uint32_t a, uint32_t b, float sqdist) {
+    const float dx = s.x[a] - s.x[b], dy = s.y[a] - s.y[b], dvx = s.vx[a] - s.vx[b], dvy = s.vy[a] - s.vy[b];
+    const float inv_a = s.inv_mass[a], inv_b = s.inv_mass[b], distance = sqrt(sqdist), dot = dx*dvx + dy*dvy;
+    const float impulse = 2*dot/((inv_a + inv_b)*sqdist);
+    s.vx[a] -= impulse*inv_a*dx; s.vy[a] -= impulse*inv_a*dy;
+    s.vx[b] += impulse*inv_b*dx; s.vy[b] += impulse*inv_b*dy;
+    separate(s, a, b, dx/distance, dy/distance, s.half_w[a] + s.half_w[b] - distance);
+}
+
+inline void CCTest(Bodies& s, uint32_t a, uint32_t b) {
+    if (s.inv_mass[a] == 0 && s.inv_mass[b] == 0) return;
+    const float dx = s.x[a] - s.x[b], dy = s.y[a] - s.y[b], r = s.half_w[a] + s.half_w[b];
+    const float sqdist = dx*dx + dy*dy;
+    if (sqdist < r*r) elasticCollision(s, a, b, sqdist);
+}
+
+// Contact geometry without any response, shared by the pair tests below and the position based solver: the unit
+// normal n points from b to a and depth is how far the shapes overlap along it; false when they do not touch.
+inline bool circleCircleContact(const Bodies& s, uint32_t a, uint32_t b, float& nx, float& ny, float& depth) {
+    const float dx = s.x[a] - s.x[b], dy = s.y[a] - s.y[b], r = s.half_w[a] + s.half_w[b];
+    const float sqdist = dx*dx + dy*dy;
+    if (sqdist >= r*r || sqdist == 0) return false;
+    const float distance = sqrt(sqdist);
+    nx = dx/distance; ny = dy/distance; depth = r - distance;
+    return true;
+}
+
+// circle against an axis aligned box: the contact normal runs from the closest point on the box to the centre, or
+// along the shallowest axis once the centre is inside the box
+inline bool circleBoxContact(const Bodies& s, uint32_t circle, uint32_t box, float& nx, float& ny, float& depth) {
+    const float r = s.half_w[circle], dx = s.x[circle] - s.x[box], dy = s.y[circle] - s.y[box];
+    const float hw = s.half_w[box], hh = s.half_h[box];
+    const float cx = std::max(-hw, std::min(hw, dx)), cy = std::max(-hh, std::min(hh, dy));
+    nx = dx - cx; ny = dy - cy;
+    const float sqdist = nx*nx + ny*ny;
+    if (sqdist >= r*r) return false;
+    if (sqdist > 0) {
+        const float distance = sqrt(sqdist);
+        nx /= distance; ny /= distance; depth = r - distance;
+    } else {
+        const float ox = hw - fabs(dx), oy = hh - fabs(dy);
+        if (ox < oy) {nx = dx < 0 ? -1.f : 1.f; ny = 0; depth = ox + r;}
+        else {nx = 0; ny = dy < 0 ? -1.f : 1.f; depth = oy + r;}
+    }
+    return true;
+}
+
+inline bool boxBoxContact(const Bodies& s, uint32_t a, uint32_t b, float& nx, float& ny, float& depth) {
+    const float dx = s.x[a] - s.x[b], dy = s.y[a] - s.y[b];
+    const float ox = s.half_w[a] + s.half_w[b] - fabs(dx), oy = s.half_h[a] + s.half_h[b] - fabs(dy);
+    if (ox <= 0 || oy <= 0) return false;
+    nx = ox < oy ? (dx < 0 ? -1.f : 1.f) : 0.f; ny = ox < oy ? 0.f : (dy < 0 ? -1.f : 1.f);
+    depth = std::min(ox, oy);
+    return true;
+}
+
+inline void CBTest(Bodies& s, uint32_t circle, uint32_t box) {
+    if (s.inv_mass[circle] == 0 && s.inv_mass[box] == 0) return;
+    float nx, ny, depth;
+    if (!circleBoxContact(s, circle, box, nx, ny, depth)) return;
+    bounce(s, circle, box, nx, ny);
+    separate(s, circle, box, nx, ny, depth);
+}
+
+inline void BBTest(Bodies& s, uint32_t a, uint32_t b) {
+    if (s.inv_mass[a] == 0 && s.inv_mass[b] == 0) return;
+    float nx, ny, depth;
+    if (!boxBoxContact(s, a, b, nx, ny, depth)) return;
+    bounce(s, a, b, nx, ny);
+    separate(s, a, b, nx, ny, depth);
+}
+
+template <int A, int B> struct PairTest;
+template <> struct PairTest<CIRCLE, CIRCLE> {static void run(Bodies& s, uint32_t a, uint32_t b) {CCTest(s, a, b);}};
+template <> struct PairTest<CIRCLE, BOX> {static void run(Bodies& s, uint32_t a, uint32_t b) {CBTest(s, a, b);}};
+template <> struct PairTest<BOX, BOX> {static void run(Bodies& s, uint32_t a, uint32_t b) {BBTest(s, a, b);}};
+
+template <int A, int B> struct PairContact;
+template <> struct PairContact<CIRCLE, CIRCLE> {
+    static bool find(const Bodies& s, uint32_t a, uint32_t b, float& nx, float& ny, float& depth) {return circleCircleContact(s, a, b, nx, ny, depth);}
+};
+template <> struct PairContact<CIRCLE, BOX> {
+    static bool find(const Bodies& s, uint32_t a, uint32_t b, float& nx, float& ny, float& depth) {return circleBoxContact(s, a, b, nx, ny, depth);}
+};
+template <> struct PairContact<BOX, BOX> {
+    static bool find(const Bodies& s, uint32_t a, uint32_t b, float& nx, float& ny, float& depth) {return boxBoxContact(s, a, b, nx, ny, depth);}
+};
+
+template <int A, int B> void collidePairs(Bodies& s, const std::vector<BodyPair>& pairs) {
+    for (uint32_t i = 0; i < pairs.size(); i++) PairTest<A, B>::run(s, pairs[i].a, pairs[i].b);
+}
+
+template <int A, int B> void collidePools(Bodies& s) {
+    for (uint32_t i = s.begin(A); i < s.end(A); i++)
+        for (uint32_t j = A == B ? i + 1 : s.begin(B); j < s.end(B); j++) PairTest<A, B>::run(s, i, j);
+}
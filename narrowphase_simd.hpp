@@ -0,0 +1,78 @@
+#pragma once
+#include "narrowphase.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86
+#endif
+
+enum SimdLevel {SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2};
+const char* const simd_names[] = {"scalar", "sse2", "avx2"};
+
+inline SimdLevel detectSimd() {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2")) return SIMD_SSE2;
+#endif
+    return SIMD_SCALAR;
+}
+
+// Circle-circle narrowphase that tests 4 or 8 pairs at once. Contact response is sequential (a pair sees the positions
+// left by the pairs before it), but only a pair that touches moves anything, so a group of consecutive pairs that all
+// miss against the current positions misses pair by pair too. Each group is tested lane-parallel and skipped when no
+// lane hits; a group with a hit goes through CCTest pair by pair, so the result is exactly what CCTest gives. Most
+// broadphase candidates miss, which is where the time goes. Where most pairs touch, every group hits and the vector test
+// is wasted, so after a group with a hit the next skip groups go straight to CCTest, skip doubling while groups keep
+// hitting and dropping back to 0 on the first group that misses.
+struct CircleBatches {
+    static constexpr uint32_t MAX_SKIP = 15;
+    SimdLevel supported = detectSimd(), level = supported;
+
+    void collide(Bodies& s, const std::vector<BodyPair>& pairs) {
+#ifdef SIMD_X86
+        if (level == SIMD_AVX2) {collideAvx2(s, pairs); return;}
+        if (level == SIMD_SSE2) {collideSse2(s, pairs); return;}
+#endif
+        collidePairs<CIRCLE, CIRCLE>(s, pairs);
+    }
+
+#ifdef SIMD_X86
+    __attribute__((target("avx2"))) static void collideAvx2(Bodies& s, const std::vector<BodyPair>& pairs) {
+        const uint32_t n = pairs.size();
+        const int32_t* p = (const int32_t*)pairs.data();
+        // two loads hold 8 pairs as a0 b0 a1 b1 ..., split into the a and the b lanes
+        const __m256i split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+        uint32_t i = 0, skip = 0;
+        while (i + 8 <= n) {
+            const __m256i lo = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(p + 2*i)), split);
+            const __m256i hi = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(p + 2*i + 8)), split);
+            const __m256i ia = _mm256_permute2x128_si256(lo, hi, 0x20), ib = _mm256_permute2x128_si256(lo, hi, 0x31);
+            const __m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(s.x.data(), ia, 4), _mm256_i32gather_ps(s.x.data(), ib, 4));
+            const __m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(s.y.data(), ia, 4), _mm256_i32gather_ps(s.y.data(), ib, 4));
+            const __m256 r = _mm256_add_ps(_mm256_i32gather_ps(s.half_w.data(), ia, 4), _mm256_i32gather_ps(s.half_w.data(), ib, 4));
+            const __m256 sqdist = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+            if (!_mm256_movemask_ps(_mm256_cmp_ps(sqdist, _mm256_mul_ps(r, r), _CMP_LT_OQ))) {i += 8; skip = 0; continue;}
+            for (const uint32_t stop = std::min(n, i + 8*(1 + skip)); i < stop; i++) CCTest(s, pairs[i].a, pairs[i].b);
+            skip = std::min(2*skip + 1, MAX_SKIP);
+        }
+        for (; i < n; i++) CCTest(s, pairs[i].a, pairs[i].b);
+    }
+
+    static void collideSse2(Bodies& s, const std::vector<BodyPair>& pairs) {
+        const uint32_t n = pairs.size();
+        const float* x = s.x.data(), * y = s.y.data(), * w = s.half_w.data();
+        uint32_t i = 0, skip = 0;
+        while (i + 4 <= n) {
+            const BodyPair* q = &pairs[i];
+            const __m128 dx = _mm_sub_ps(_mm_setr_ps(x[q[0].a], x[q[1].a], x[q[2].a], x[q[3].a]), _mm_setr_ps(x[q[0].b], x[q[1].b], x[q[2].b], x[q[3].b]));
+            const __m128 dy = _mm_sub_ps(_mm_setr_ps(y[q[0].a], y[q[1].a], y[q[2].a], y[q[3].a]), _mm_setr_ps(y[q[0].b], y[q[1].b], y[q[2].b], y[q[3].b]));
+            const __m128 r = _mm_add_ps(_mm_setr_ps(w[q[0].a], w[q[1].a], w[q[2].a], w[q[3].a]), _mm_setr_ps(w[q[0].b], w[q[1].b], w[q[2].b], w[q[3].b]));
+            const __m128 sqdist = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+            if (!_mm_movemask_ps(_mm_cmplt_ps(sqdist, _mm_mul_ps(r, r)))) {i += 4; skip = 0; continue;}
+            for (const uint32_t stop = std::min(n, i + 4*(1 + skip)); i < stop; i++) CCTest(s, pairs[i].a, pairs[i].b);
+            skip = std::min(2*skip + 1, MAX_SKIP);
+        }
+        for (; i < n; i++) CCTest(s, pairs[i].a, pairs[i].b);
+    }
+#endif
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include "narrowphase.hpp"
+#include "thread_pool.hpp"
+
+// Greedy edge colouring of the contact graph: every pair takes the lowest colour neither of its bodies has used yet, so
+// the pairs of one colour never share a body and can run on any number of threads at once. The colours run one after
+// another, which makes the result independent of the thread count. Pairs of a body that already used up all COLOURS
+// (a big static floor touching hundreds of circles) land in the tail colour, which runs on the calling thread.
+struct PairColouring {
+    static constexpr int COLOURS = 64;
+    std::vector<uint64_t> used; // per body mask of colours taken, cleared again after every build
+    std::vector<uint8_t> colour;
+    std::vector<BodyPair> sorted; // pairs grouped by colour, start[c] .. start[c + 1]
+    uint32_t start[COLOURS + 2] = {};
+
+    void build(const std::vector<BodyPair>& pairs, uint32_t bodies) {
+        if (used.size() < bodies) used.resize(bodies, 0);
+        colour.resize(pairs.size());
+        uint32_t counts[COLOURS + 1] = {};
+        uint64_t* mask = used.data();
+        for (uint32_t i = 0; i < pairs.size(); i++) {
+            const uint32_t a = pairs[i].a, b = pairs[i].b;
+            const uint64_t free = ~(mask[a] | mask[b]);
+            const int c = free ? __builtin_ctzll(free) : COLOURS;
+            if (c < COLOURS) {mask[a] |= 1ull << c; mask[b] |= 1ull << c;}
+            colour[i] = c; counts[c]++;
+        }
+        start[0] = 0;
+        for (int c = 0; c <= COLOURS; c++) start[c + 1] = start[c] + counts[c];
+        uint32_t fill[COLOURS + 1];
+        std::copy(start, start + COLOURS + 1, fill);
+        sorted.resize(pairs.size());
+        for (uint32_t i = 0; i < pairs.size(); i++) {
+            sorted[fill[colour[i]]++] = pairs[i];
+            mask[pairs[i].a] = mask[pairs[i].b] = 0;
+        }
+    }
+};
+
+template <int A, int B> void collideColoured(Bodies& s, const PairColouring& colouring, ThreadPool& pool) {
+    const BodyPair* pairs = colouring.sorted.data();
+    auto run = [&](uint32_t begin, uint32_t end) {for (uint32_t i = begin; i < end; i++) PairTest<A, B>::run(s, pairs[i].a, pairs[i].b);};
+    for (int c = 0; c < PairColouring::COLOURS; c++) {
+        const uint32_t begin = colouring.start[c], end = colouring.start[c + 1];
+        if (begin == end) break; // colours are handed out lowest first, so the first empty one ends the list
+        pool.parallelFor(end - begin, 512, [&](uint32_t b, uint32_t e) {run(begin + b, begin + e);});
+    }
+    run(colouring.start[PairColouring::COLOURS], colouring.start[PairColouring::COLOURS + 1]);
+}
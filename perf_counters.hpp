@@ -0,0 +1,144 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+enum PerfEvent {PERF_CACHE_REFERENCES, PERF_CACHE_MISSES, PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_CYCLES, PERF_INSTRUCTIONS,
+                PERF_BRANCH_MISSES, PERF_EVENT_COUNT};
+const char* const perf_event_names[] = {"cache_references", "cache_misses", "l1d_misses", "llc_misses", "cycles", "instructions",
+                                        "branch_misses"};
+
+#ifdef __linux__
+// user space only; disabled until started. group is the fd of the group leader, or -1 to start a group
+inline int openPerfEvent(PerfEvent event, int group, uint64_t read_format) {
+    uint32_t type = PERF_TYPE_HARDWARE;
+    uint64_t config = PERF_COUNT_HW_CACHE_REFERENCES;
+    if (event == PERF_CACHE_MISSES) config = PERF_COUNT_HW_CACHE_MISSES;
+    if (event == PERF_CYCLES) config = PERF_COUNT_HW_CPU_CYCLES;
+    if (event == PERF_INSTRUCTIONS) config = PERF_COUNT_HW_INSTRUCTIONS;
+    if (event == PERF_BRANCH_MISSES) config = PERF_COUNT_HW_BRANCH_MISSES;
+    if (event == PERF_L1D_MISSES || event == PERF_LLC_MISSES) {
+        type = PERF_TYPE_HW_CACHE;
+        config = (event == PERF_L1D_MISSES ? PERF_COUNT_HW_CACHE_L1D : PERF_COUNT_HW_CACHE_LL)
+                 | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    }
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr); attr.type = type; attr.config = config; attr.read_format = read_format;
+    attr.disabled = group < 0; attr.exclude_kernel = 1; attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+// One hardware event counted for the calling thread through perf_event_open, user space only. Where the kernel or the
+// machine does not offer the event (no PMU in a VM, perf_event_paranoid too strict, not Linux) open() returns false
+// and the counter just reads as unavailable. When more events are open than the PMU has counters, the kernel takes
+// turns between them, and read scales the count up to the whole time the counter was enabled.
+struct PerfCounter {
+    int fd = -1;
+
+    PerfCounter() = default;
+    PerfCounter(const PerfCounter&) = delete;
+    PerfCounter& operator=(const PerfCounter&) = delete;
+    ~PerfCounter() {close();}
+
+    bool open(PerfEvent event) {
+        close();
+#ifdef __linux__
+        fd = openPerfEvent(event, -1, PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING);
+#endif
+        return fd >= 0;
+    }
+    void close() {
+#ifdef __linux__
+        if (fd >= 0) ::close(fd);
+#endif
+        fd = -1;
+    }
+    bool available() const {return fd >= 0;}
+    void start() {
+#ifdef __linux__
+        if (fd >= 0) {ioctl(fd, PERF_EVENT_IOC_RESET, 0); ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);}
+#endif
+    }
+    void stop() {
+#ifdef __linux__
+        if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    }
+    uint64_t read() const {
+        uint64_t value[3] = {}; // count, time enabled, time running
+#ifdef __linux__
+        if (fd >= 0 && ::read(fd, value, sizeof(value)) != sizeof(value)) return 0;
+#endif
+        return value[2] ? (uint64_t)((double)value[0]*value[1]/value[2]) : 0;
+    }
+};
+
+// Several events counted as one group, so they are always scheduled together and one read returns all of them; cheap
+// enough to sample around every stage of a step. Events the machine lacks are left out of the group and read as
+// unavailable, the rest still count. A group only counts while all its events fit on the PMU at once, so it should
+// stay within the few general counters there are (cycles and instructions usually have fixed ones of their own).
+struct PerfGroup {
+    struct Sample {
+        uint64_t enabled, running;
+        uint64_t values[PERF_EVENT_COUNT];
+    };
+    int fds[PERF_EVENT_COUNT];
+    PerfEvent events[PERF_EVENT_COUNT];
+    int count = 0, members = 0; // events asked for, and how many of them are open
+    int slot[PERF_EVENT_COUNT]; // position of each event in the group read, -1 if it is not open
+
+    PerfGroup() {close();}
+    PerfGroup(const PerfGroup&) = delete;
+    PerfGroup& operator=(const PerfGroup&) = delete;
+    ~PerfGroup() {close();}
+
+    bool open(const PerfEvent* events, int count) {
+        close();
+        this->count = count;
+        for (int i = 0; i < count; i++) {
+            this->events[i] = events[i];
+            slot[i] = -1;
+#ifdef __linux__
+            const int fd = openPerfEvent(events[i], members ? fds[0] : -1,
+                                         PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING);
+            if (fd >= 0) {slot[i] = members; fds[members++] = fd;}
+#endif
+        }
+        return members > 0;
+    }
+    void close() {
+#ifdef __linux__
+        for (int i = members - 1; i >= 0; i--) ::close(fds[i]);
+#endif
+        for (int i = 0; i < PERF_EVENT_COUNT; i++) slot[i] = -1;
+        count = members = 0;
+    }
+    bool available() const {return members > 0;}
+    bool available(int i) const {return slot[i] >= 0;}
+    void start() {
+#ifdef __linux__
+        if (members) {ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP); ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);}
+#endif
+    }
+    void stop() {
+#ifdef __linux__
+        if (members) ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+    // raw counts in the order of the events passed to open; scale differences of two samples by their times
+    void read(Sample& sample) const {
+        uint64_t data[3 + PERF_EVENT_COUNT] = {}; // number of events, time enabled, time running, the counts
+#ifdef __linux__
+        if (members && ::read(fds[0], data, (3 + members)*sizeof(uint64_t)) != (ssize_t)((3 + members)*sizeof(uint64_t))) memset(data, 0, sizeof(data));
+#endif
+        sample.enabled = data[1]; sample.running = data[2];
+        for (int i = 0; i < count; i++) sample.values[i] = slot[i] >= 0 ? data[3 + slot[i]] : 0;
+    }
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+// Trace scopes for looking at single frames in chrome://tracing or ui.perfetto.dev. They are only compiled in with
+// -DPHYSICS_PROFILE (make PROFILE=1); otherwise PROFILE_SCOPE expands to nothing and nothing below exists.
+//
+// A scope reads the time stamp counter on entry and exit and appends {name, begin, end} to a ring of the calling
+// thread, so it costs two counter reads and a store. Names must be string literals or otherwise outlive the dump. Each
+// thread gets its own ring the first time it records; the newest CAPACITY events per thread are kept.
+// writeChromeTrace can run while other threads record: it copies each ring and drops whatever was overwritten during
+// the copy. Counter ticks are converted to time by comparing against steady_clock at startup and at the dump.
+#ifdef PHYSICS_PROFILE
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+inline uint64_t traceTicks() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct TraceEvent {const char* name; uint64_t begin, end;};
+
+struct TraceBuffer {
+    static constexpr uint32_t CAPACITY = 1 << 16;
+    std::vector<TraceEvent> events = std::vector<TraceEvent>(CAPACITY);
+    std::atomic<uint64_t> head{0}; // events recorded so far
+    uint32_t thread = 0;
+
+    void push(const char* name, uint64_t begin, uint64_t end) {
+        const uint64_t h = head.load(std::memory_order_relaxed);
+        events[h & (CAPACITY - 1)] = {name, begin, end};
+        head.store(h + 1, std::memory_order_release);
+    }
+};
+
+struct Profiler {
+    typedef std::chrono::steady_clock Clock;
+    std::mutex mutex;
+    std::vector<TraceBuffer*> buffers; // never freed, so the events of finished threads still make it into the dump
+    uint64_t start_ticks = traceTicks();
+    Clock::time_point start_time = Clock::now();
+
+    static Profiler& instance() {static Profiler profiler; return profiler;}
+    static TraceBuffer& local() {
+        static thread_local TraceBuffer* buffer = nullptr;
+        if (!buffer) buffer = instance().add();
+        return *buffer;
+    }
+    TraceBuffer* add() {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffers.push_back(new TraceBuffer());
+        buffers.back()->thread = buffers.size();
+        return buffers.back();
+    }
+
+    bool writeChromeTrace(const char* path) {
+        FILE* file = fopen(path, "w");
+        if (!file) return false;
+        const double seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+        const uint64_t ticks = traceTicks() - start_ticks;
+        const double us_per_tick = ticks ? seconds*1e6/ticks : 0;
+        std::vector<TraceEvent> copy;
+        std::lock_guard<std::mutex> lock(mutex);
+        fprintf(file, "{\"traceEvents\": [");
+        bool first = true;
+        for (TraceBuffer* b : buffers) {
+            const uint64_t end = b->head.load(std::memory_order_acquire), begin = end > TraceBuffer::CAPACITY ? end - TraceBuffer::CAPACITY : 0;
+            copy.clear();
+            for (uint64_t i = begin; i < end; i++) copy.push_back(b->events[i & (TraceBuffer::CAPACITY - 1)]);
+            // events whose slot the thread has started to reuse since may be torn
+            const uint64_t after = b->head.load(std::memory_order_acquire);
+            const uint64_t valid = after >= TraceBuffer::CAPACITY ? after - TraceBuffer::CAPACITY + 1 : 0;
+            for (uint64_t i = std::max(begin, valid); i < end; i++) {
+                const TraceEvent& e = copy[i - begin];
+                fprintf(file, "%s\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}", first ? "" : ",",
+                        e.name, b->thread, (double)(int64_t)(e.begin - start_ticks)*us_per_tick, (double)(e.end - e.begin)*us_per_tick);
+                first = false;
+            }
+        }
+        fprintf(file, "\n]}\n");
+        return fclose(file) == 0;
+    }
+};
+
+struct TraceScope {
+    const char* name = nullptr;
+    uint64_t begin = 0;
+
+    TraceScope() = default;
+    explicit TraceScope(const char* name) {start(name);}
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+    ~TraceScope() {if (name) Profiler::local().push(name, begin, traceTicks());}
+
+    void start(const char* name) {this->name = name; begin = traceTicks();}
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) TraceScope PROFILE_CONCAT(trace_scope_, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "thread_pool.hpp"
+
+// Stable LSD radix sort of 32 bit keys with a value each, 8 bits per pass. Every pass splits the range into one chunk
+// per thread: the chunks count their digits in parallel, a serial prefix sum over digit-major, chunk-minor counts gives
+// every chunk its own output positions per digit, and the chunks scatter in parallel. Passes where every key has the
+// same digit are skipped, which for codes of a small scene drops the top passes.
+struct RadixSort {
+    std::vector<uint32_t> keys_tmp, values_tmp, counts;
+
+    void sort(uint32_t* keys, uint32_t* values, uint32_t n, ThreadPool& pool) {
+        if (n < 2) return;
+        keys_tmp.resize(n); values_tmp.resize(n);
+        const uint32_t chunks = std::min<uint32_t>(pool.size(), std::max(1u, n/4096));
+        counts.resize(256*chunks);
+        uint32_t* key = keys, * value = values, * key_out = keys_tmp.data(), * value_out = values_tmp.data();
+        for (int shift = 0; shift < 32; shift += 8) {
+            std::fill(counts.begin(), counts.end(), 0u);
+            pool.parallelFor(chunks, 1, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t c = begin; c < end; c++) {
+                    uint32_t* count = &counts[256*c];
+                    for (uint32_t i = n*(uint64_t)c/chunks; i < n*(uint64_t)(c + 1)/chunks; i++) count[key[i] >> shift & 255]++;
+                }
+            });
+            uint32_t total = 0;
+            bool trivial = false;
+            for (uint32_t d = 0; d < 256; d++) {
+                const uint32_t first = total;
+                for (uint32_t c = 0; c < chunks; c++) {
+                    const uint32_t count = counts[256*c + d];
+                    counts[256*c + d] = total; total += count;
+                }
+                if (total - first == n) trivial = true;
+            }
+            if (trivial) continue;
+            pool.parallelFor(chunks, 1, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t c = begin; c < end; c++) {
+                    uint32_t* offset = &counts[256*c];
+                    for (uint32_t i = n*(uint64_t)c/chunks; i < n*(uint64_t)(c + 1)/chunks; i++) {
+                        const uint32_t at = offset[key[i] >> shift & 255]++;
+                        key_out[at] = key[i]; value_out[at] = value[i];
+                    }
+                }
+            });
+            std::swap(key, key_out); std::swap(value, value_out);
+        }
+        if (key != keys) {std::copy(key, key + n, keys); std::copy(value, value + n, values);}
+    }
+};
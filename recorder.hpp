@@ -0,0 +1,186 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "trajectory.hpp"
+
+// Lock free single producer single consumer ring. The producer fills writeSlot() and pushes it, the consumer reads
+// readSlot() and pops it; a null slot means the ring is full or empty. Slots are reused as they are, so vectors inside
+// them keep their capacity and a warmed up ring no longer allocates.
+template <class T> struct SpscRing {
+    std::vector<T> slots;
+    std::atomic<uint64_t> head{0}, tail{0}; // pushed and popped so far
+
+    SpscRing(uint32_t capacity) : slots(capacity) {}
+
+    T* writeSlot() {
+        const uint64_t h = head.load(std::memory_order_relaxed);
+        return h - tail.load(std::memory_order_acquire) < slots.size() ? &slots[h%slots.size()] : nullptr;
+    }
+    void push() {head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);}
+    // ahead > 0 peeks at the slots behind the next one
+    T* readSlot(uint32_t ahead = 0) {
+        const uint64_t t = tail.load(std::memory_order_relaxed) + ahead;
+        return t < head.load(std::memory_order_acquire) ? &slots[t%slots.size()] : nullptr;
+    }
+    void pop() {tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);}
+    uint64_t size() const {return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);}
+};
+
+// Records every step of a scene into a trajectory file (see trajectory.hpp) without slowing the simulation down.
+// capture, called by Scene::update while Scene::recorder is set, only copies the drawn columns into the next slot
+// of a ring. A writer thread takes the steps from there, quantizes them into handle order, encodes them and writes
+// the chunks out. When the writer falls behind and the ring is full, capture drops the step instead of waiting, so
+// the simulation never blocks on the disk; dropped counts those steps, and the frames around a hole keep their step
+// numbers. A failed write stops the recording, recording() turns false and close() reports it; steps captured after
+// that are dropped too. The chunks are only as small as the delta coding of trajectory.hpp makes them, no general
+// purpose compressor runs over them.
+//
+// A chunk's box is the bounding box of its keyframe grown by a quarter of its size on every side. A new chunk starts
+// every keyframe_interval frames, or as soon as a body leaves the box.
+struct Recorder {
+    // one step as the simulation left it, in slot order
+    struct Step {
+        uint64_t step = 0;
+        uint32_t ids = 0; // handles ever handed out
+        std::vector<float> x, y, half_w, half_h;
+        std::vector<int8_t> shape, group;
+        std::vector<uint32_t> handle;
+    };
+    uint32_t keyframe_interval = 60;
+    SpscRing<Step> ring{16};
+    std::thread thread;
+    std::atomic<bool> running{false}, write_failed{false};
+    uint64_t dropped = 0, frames = 0, bytes = 0;
+    // writer side
+    FILE* file = nullptr;
+    TrajectoryFrame frame;
+    FrameCodec codec;
+    ChunkHeader chunk = {};
+    std::vector<uint8_t> payload;
+    std::vector<ChunkEntry> chunks;
+    std::vector<uint32_t> frame_chunk;
+
+    Recorder() = default;
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+    ~Recorder() {close();}
+
+    bool recording() const {return running && !write_failed;}
+
+    bool open(const char* path) {
+        close();
+        file = fopen(path, "wb");
+        if (!file) return false;
+        TrajectoryHeader header = {};
+        memcpy(header.magic, "PHYSTRAJ", 8);
+        header.version = TRAJECTORY_VERSION; header.byte_order = 0x01020304; header.keyframe_interval = keyframe_interval;
+        if (fwrite(&header, sizeof(header), 1, file) != 1) {fclose(file); file = nullptr; return false;}
+        write_failed = false;
+        dropped = frames = 0; bytes = sizeof(header);
+        chunk.frames = 0; chunks.clear(); frame_chunk.clear();
+        running = true;
+        thread = std::thread([this] {write();});
+        return true;
+    }
+    // waits for the writer to finish every captured step, then writes the index; false if any write failed, the file
+    // is then incomplete
+    bool close() {
+        if (!running) return true;
+        running = false;
+        thread.join();
+        finishChunk();
+        if (!write_failed) {
+            const uint64_t index_offset = bytes;
+            TrajectoryTrailer trailer = {index_offset, chunks.size(), frame_chunk.size(), {}};
+            memcpy(trailer.magic, "TRAJINDX", 8);
+            if (fwrite(chunks.data(), sizeof(ChunkEntry), chunks.size(), file) != chunks.size() ||
+                fwrite(frame_chunk.data(), sizeof(uint32_t), frame_chunk.size(), file) != frame_chunk.size() ||
+                fwrite(&trailer, sizeof(trailer), 1, file) != 1) write_failed = true;
+            else bytes += chunks.size()*sizeof(ChunkEntry) + frame_chunk.size()*sizeof(uint32_t) + sizeof(trailer);
+        }
+        if (fclose(file) != 0) write_failed = true;
+        file = nullptr;
+        return !write_failed;
+    }
+
+    void capture(const Bodies& s, uint64_t step) {
+        if (!running || write_failed) return;
+        Step* slot = ring.writeSlot();
+        if (!slot) {dropped++; return;}
+        slot->step = step; slot->ids = s.handles.index.size();
+        slot->x.assign(s.x.begin(), s.x.end()); slot->y.assign(s.y.begin(), s.y.end());
+        slot->half_w.assign(s.half_w.begin(), s.half_w.end()); slot->half_h.assign(s.half_h.begin(), s.half_h.end());
+        slot->shape.assign(s.shape.begin(), s.shape.end()); slot->group.assign(s.group.begin(), s.group.end());
+        slot->handle.assign(s.handles.handle.begin(), s.handles.handle.end());
+        ring.push();
+    }
+
+    void write() {
+        while (true) {
+            const bool stopping = !running; // read first: once stopping, every step has already been pushed
+            Step* step = ring.readSlot();
+            if (!step) {
+                if (stopping) return;
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                continue;
+            }
+            if (!write_failed) writeStep(*step);
+            ring.pop();
+        }
+    }
+
+    void writeStep(const Step& s) {
+        const uint32_t n = s.x.size();
+        float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+        for (uint32_t i = 0; i < n; i++) {
+            min_x = std::min(min_x, s.x[i] - s.half_w[i]); max_x = std::max(max_x, s.x[i] + s.half_w[i]);
+            min_y = std::min(min_y, s.y[i] - s.half_h[i]); max_y = std::max(max_y, s.y[i] + s.half_h[i]);
+        }
+        const float limit = 65535*chunk.scale;
+        const bool inside = !(min_x < chunk.min_x || min_y < chunk.min_y || max_x > chunk.min_x + limit || max_y > chunk.min_y + limit);
+        if (!chunk.frames || chunk.frames == keyframe_interval || !inside || s.ids < codec.previous.ids) {
+            finishChunk();
+            if (!n) {min_x = min_y = 0; max_x = max_y = 1;}
+            const float extent = std::max(std::max(max_x - min_x, max_y - min_y), 1.f), margin = extent/4;
+            chunk.min_x = min_x - margin; chunk.min_y = min_y - margin; chunk.scale = (extent + 2*margin)/65535;
+            chunk.first_frame = frames;
+            codec.reset();
+        }
+
+        frame.step = s.step;
+        frame.resize(s.ids);
+        for (int k = 0; k < TRAJ_COLUMNS; k++) std::fill(frame.values[k].begin(), frame.values[k].end(), 0);
+        const float inv_scale = 1/chunk.scale;
+        auto position = [&](float v, float min) {return (uint16_t)std::min(65535.f, std::max(0.f, std::round((v - min)*inv_scale)));};
+        auto size = [&](float v) {return (uint16_t)std::min(65535.f, std::ceil(v*inv_scale));};
+        for (uint32_t i = 0; i < n; i++) {
+            const uint32_t id = s.handle[i];
+            frame.values[TRAJ_TAG][id] = TrajectoryFrame::tag(s.shape[i], s.group[i]);
+            frame.values[TRAJ_X][id] = position(s.x[i], chunk.min_x);
+            frame.values[TRAJ_Y][id] = position(s.y[i], chunk.min_y);
+            frame.values[TRAJ_HALF_W][id] = size(s.half_w[i]);
+            frame.values[TRAJ_HALF_H][id] = size(s.half_h[i]);
+        }
+        codec.encode(frame, payload);
+        chunk.frames++;
+        frame_chunk.push_back(chunks.size());
+        frames++;
+    }
+
+    void finishChunk() {
+        if (!chunk.frames || write_failed) return;
+        chunk.magic = CHUNK_MAGIC; chunk.bytes = payload.size();
+        if (fwrite(&chunk, sizeof(chunk), 1, file) != 1 || fwrite(payload.data(), 1, payload.size(), file) != payload.size()) {
+            write_failed = true;
+            return;
+        }
+        chunks.push_back({bytes, chunk.first_frame, chunk.frames, chunk.bytes});
+        bytes += sizeof(chunk) + payload.size();
+        payload.clear();
+        chunk.frames = 0;
+    }
+};
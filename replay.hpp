@@ -0,0 +1,209 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include "mapped_file.hpp"
+#include "recorder.hpp"
+#include "snapshot.hpp"
+
+// Plays back a trajectory file (see trajectory.hpp). The file is mapped rather than read, so only the chunks around
+// the playhead are ever paged in and a recording far larger than memory plays just the same. The index at the end of
+// the file gives the chunk of every frame; a file whose recording was cut short has no index, and open rebuilds it
+// by walking the chunk headers. Seeking decodes from the chunk's keyframe, at most keyframe_interval frames.
+//
+// A worker thread decodes the frames following the playhead into Snapshots in a ring, so the render side only picks
+// the right one and draws it like a live scene. Every frame has to be decoded, but only the ones the display will
+// pick are turned into Snapshots and handed out: show tells the worker where the playhead is and how far it moved
+// since the last call, and the worker skips the frames in between. So at high speeds the ring still reaches as many
+// display frames ahead. When the playhead jumps backwards or far ahead, the worker is told to start over from there,
+// and every slot it decoded before that is thrown away unseen.
+struct TrajectoryPlayer {
+    struct Decoded {
+        uint64_t frame = 0, generation = 0;
+        Snapshot snapshot;
+    };
+    MappedFile file;
+    std::vector<ChunkEntry> chunks;
+    std::vector<uint32_t> frame_chunk; // chunk of every frame
+    uint32_t keyframe_interval = 0;
+    SpscRing<Decoded> ring{32};
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> generation{0}, start{0}; // seek requests: decoding starts over at start for each generation
+    std::atomic<uint64_t> decodable{0}; // frames before the first one that failed to decode
+    std::atomic<uint64_t> wanted{0}, stride{1}; // the frame last shown, and how far the playhead moved to it
+    std::atomic<uint64_t> passed{0}; // the worker has handed out or skipped every frame before this one
+
+    TrajectoryPlayer() = default;
+    TrajectoryPlayer(const TrajectoryPlayer&) = delete;
+    TrajectoryPlayer& operator=(const TrajectoryPlayer&) = delete;
+    ~TrajectoryPlayer() {close();}
+
+    uint64_t frames() const {return frame_chunk.size();}
+
+    bool open(const char* path) {
+        close();
+        if (!file.open(path) || file.size < sizeof(TrajectoryHeader)) return false;
+        const uint8_t* data = (const uint8_t*)file.data;
+        TrajectoryHeader header;
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, "PHYSTRAJ", 8) || header.version != TRAJECTORY_VERSION || header.byte_order != 0x01020304) {
+            file.close();
+            return false;
+        }
+        keyframe_interval = header.keyframe_interval;
+        if (!readIndex()) scanChunks();
+        decodable = frames();
+        generation = 0; start = 0; wanted = 0; stride = 1; passed = 0;
+        running = true;
+        thread = std::thread([this] {decode();});
+        return true;
+    }
+    void close() {
+        if (running) {running = false; thread.join();}
+        while (ring.readSlot()) ring.pop();
+        file.close();
+        chunks.clear(); frame_chunk.clear();
+    }
+
+    bool readIndex() {
+        const uint8_t* data = (const uint8_t*)file.data;
+        if (file.size < sizeof(TrajectoryHeader) + sizeof(TrajectoryTrailer)) return false;
+        TrajectoryTrailer trailer;
+        memcpy(&trailer, data + file.size - sizeof(trailer), sizeof(trailer));
+        if (memcmp(trailer.magic, "TRAJINDX", 8) || trailer.index_offset > file.size ||
+            trailer.chunks*sizeof(ChunkEntry) + trailer.frames*sizeof(uint32_t) != file.size - sizeof(trailer) - trailer.index_offset)
+            return false;
+        chunks.resize(trailer.chunks); frame_chunk.resize(trailer.frames);
+        memcpy(chunks.data(), data + trailer.index_offset, chunks.size()*sizeof(ChunkEntry));
+        memcpy(frame_chunk.data(), data + trailer.index_offset + chunks.size()*sizeof(ChunkEntry), frame_chunk.size()*sizeof(uint32_t));
+        for (uint32_t i = 0; i < chunks.size(); i++)
+            if (chunks[i].offset + sizeof(ChunkHeader) + chunks[i].bytes > trailer.index_offset) {chunks.clear(); frame_chunk.clear(); return false;}
+        for (uint64_t i = 0; i < frame_chunk.size(); i++)
+            if (frame_chunk[i] >= chunks.size()) {chunks.clear(); frame_chunk.clear(); return false;}
+        return true;
+    }
+    // the index of a file without one: every whole chunk up to the first damaged or missing one
+    void scanChunks() {
+        const uint8_t* data = (const uint8_t*)file.data;
+        uint64_t offset = sizeof(TrajectoryHeader);
+        ChunkHeader chunk;
+        while (offset + sizeof(chunk) <= file.size) {
+            memcpy(&chunk, data + offset, sizeof(chunk));
+            if (chunk.magic != CHUNK_MAGIC || chunk.bytes > file.size - offset - sizeof(chunk) || chunk.first_frame != frame_chunk.size()) break;
+            for (uint32_t i = 0; i < chunk.frames; i++) frame_chunk.push_back(chunks.size());
+            chunks.push_back({offset, chunk.first_frame, chunk.frames, chunk.bytes});
+            offset += sizeof(chunk) + chunk.bytes;
+        }
+    }
+
+    // the snapshot to draw for frame, or null while nothing usable has been decoded yet. Until the worker catches up,
+    // this is the newest decoded frame before it.
+    const Snapshot* show(uint64_t frame) {
+        const uint64_t previous = wanted.exchange(frame, std::memory_order_relaxed);
+        const uint64_t g = generation.load(std::memory_order_relaxed);
+        Decoded* shown = ring.readSlot(), * newest = shown ? ring.readSlot(ring.size() - 1) : nullptr;
+        const bool ahead = shown && shown->generation == g && shown->frame > frame;
+        // decoding on from where the worker is beats starting over at a keyframe until the gap is a whole chunk
+        const bool far = newest && newest->generation == g && frame > newest->frame + keyframe_interval;
+        if (ahead || far || (!shown && frame < start.load(std::memory_order_relaxed))) seek(frame, g);
+        else if (frame > previous) stride.store(frame - previous, std::memory_order_relaxed);
+        const uint64_t current = generation.load(std::memory_order_relaxed);
+        // drop stale slots and every slot with a later one still at or before frame, but keep the last one on screen
+        // while waiting for more
+        while (Decoded* s = ring.readSlot()) {
+            const Decoded* after = ring.readSlot(1);
+            if (!after || (s->generation == current && !(after->generation == current && after->frame <= frame))) break;
+            ring.pop();
+        }
+        Decoded* s = ring.readSlot();
+        if (!s || s->frame > frame) return nullptr;
+        // the playhead stopped on a frame the worker skipped while it was moving: fetch that one after all
+        if (s->generation == current && s->frame < frame && frame == previous && passed.load(std::memory_order_acquire) > frame)
+            seek(frame, current);
+        return &s->snapshot;
+    }
+    void seek(uint64_t frame, uint64_t g) {
+        start.store(frame, std::memory_order_relaxed);
+        generation.store(g + 1, std::memory_order_release);
+    }
+
+    void decode() {
+        FrameCodec codec;
+        TrajectoryFrame frame;
+        ChunkHeader chunk = {};
+        const uint8_t* in = nullptr, * end = nullptr;
+        uint64_t g = ~0ull, next = 0, handed = ~0ull;
+        bool pending = false; // frame next - 1 is decoded and waits for a free slot
+        while (running) {
+            if (generation.load(std::memory_order_acquire) != g) {
+                g = generation.load(std::memory_order_acquire);
+                next = std::min(start.load(std::memory_order_relaxed), frames());
+                handed = ~0ull; pending = false;
+                passed.store(next, std::memory_order_release);
+                // decode the chunk's frames before next without handing them out
+                if (next < decodable) {
+                    const ChunkEntry& entry = chunks[frame_chunk[next]];
+                    if (!openChunk(entry, chunk, in, end)) {decodable = next; continue;}
+                    codec.reset();
+                    for (uint64_t i = entry.first_frame; i < next; i++) if (!codec.decode(in, end, frame)) {decodable = i; break;}
+                }
+            }
+            if (pending) {
+                Decoded* slot = ring.writeSlot();
+                if (!slot) {std::this_thread::sleep_for(std::chrono::microseconds(500)); continue;}
+                fill(frame, chunk, slot->snapshot);
+                slot->frame = handed = next - 1; slot->generation = g;
+                ring.push();
+                passed.store(next, std::memory_order_release);
+                pending = false;
+                continue;
+            }
+            if (next >= decodable) {std::this_thread::sleep_for(std::chrono::microseconds(500)); continue;}
+            if (next == chunks[frame_chunk[next]].first_frame) {
+                if (!openChunk(chunks[frame_chunk[next]], chunk, in, end)) {decodable = next; continue;}
+                codec.reset();
+            }
+            if (!codec.decode(in, end, frame)) {decodable = next; continue;}
+            // behind the playhead or between two frames the display will show: decoded only to get to the next one
+            const uint64_t w = wanted.load(std::memory_order_relaxed), s = stride.load(std::memory_order_relaxed);
+            pending = (next >= w && (handed == ~0ull || handed < w || next >= handed + s)) || next + 1 == frames();
+            next++;
+            if (!pending) passed.store(next, std::memory_order_release);
+        }
+    }
+
+    bool openChunk(const ChunkEntry& entry, ChunkHeader& chunk, const uint8_t*& in, const uint8_t*& end) {
+        memcpy(&chunk, (const uint8_t*)file.data + entry.offset, sizeof(chunk));
+        if (chunk.magic != CHUNK_MAGIC || chunk.bytes != entry.bytes) return false;
+        in = (const uint8_t*)file.data + entry.offset + sizeof(chunk);
+        end = in + chunk.bytes;
+        return true;
+    }
+
+    // bodies in shape order like the scene keeps them; nothing to interpolate, so x_old = x
+    static void fill(const TrajectoryFrame& f, const ChunkHeader& chunk, Snapshot& out) {
+        uint32_t count[SHAPE_COUNT] = {};
+        for (uint32_t id = 0; id < f.ids; id++) if (f.present(id)) count[f.shape(id)]++;
+        out.pool[0] = 0;
+        for (int t = 0; t < SHAPE_COUNT; t++) out.pool[t + 1] = out.pool[t] + count[t];
+        const uint32_t n = out.pool[SHAPE_COUNT];
+        out.x.resize(n); out.y.resize(n); out.half_w.resize(n); out.half_h.resize(n); out.group.resize(n);
+        uint32_t slot[SHAPE_COUNT];
+        for (int t = 0; t < SHAPE_COUNT; t++) slot[t] = out.pool[t];
+        for (uint32_t id = 0; id < f.ids; id++) {
+            if (!f.present(id)) continue;
+            const uint32_t i = slot[f.shape(id)]++;
+            out.x[i] = chunk.min_x + f.values[TRAJ_X][id]*chunk.scale;
+            out.y[i] = chunk.min_y + f.values[TRAJ_Y][id]*chunk.scale;
+            out.half_w[i] = f.values[TRAJ_HALF_W][id]*chunk.scale;
+            out.half_h[i] = f.values[TRAJ_HALF_H][id]*chunk.scale;
+            out.group[i] = f.group(id);
+        }
+        out.x_old.assign(out.x.begin(), out.x.end()); out.y_old.assign(out.y.begin(), out.y.end());
+        out.spring_a.clear(); out.spring_b.clear();
+        out.alpha = 1; out.steps = f.step;
+    }
+};
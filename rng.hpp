@@ -0,0 +1,17 @@
+#pragma once
+#include <cstdint>
+
+// Seeded generator (splitmix64) for scene setup. Unlike rand() the sequence is the same on every platform and run, and
+// every Scene owns its own state, so a benchmark scenario builds the identical scene from the same seed.
+struct Rng {
+    uint64_t state;
+    Rng(uint64_t seed = 1) {this->state = seed;}
+    uint32_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+        return (z ^ (z >> 31)) >> 32;
+    }
+    // uniform in [min, max)
+    float range(float min, float max) {return min + (max - min)*(next() >> 8)*(1.f/16777216);}
+};
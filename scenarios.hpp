@@ -0,0 +1,94 @@
+#pragma once
+#include "scene.hpp"
+
+// Canned scenes shared by the app and the headless benchmark. setup builds the scene from scene.rng, so a seed always
+// gives the same scene; spawn, when set, runs before every step for scenarios that keep adding bodies.
+struct Scenario {
+    const char* name;
+    uint32_t default_bodies;
+    void (*setup)(Scene& scene, uint32_t bodies);
+    void (*spawn)(Scene& scene, uint64_t step, uint32_t bodies);
+};
+
+// static frame around the square 0..width x 0..height, tiled from small boxes because the uniform grid sizes its
+// cells by the largest body and a single box per wall would make it one cell
+inline void addWalls(Scene& scene, float width, float height) {
+    const float tile = 40;
+    for (float x = -tile; x < width + tile; x += tile) {
+        scene.addBox(x, -tile, tile, tile, 0, true);
+        scene.addBox(x, height, tile, tile, 0, true);
+    }
+    for (float y = 0; y < height; y += tile) {
+        scene.addBox(-tile, y, tile, tile, 0, true);
+        scene.addBox(width, y, tile, tile, 0, true);
+    }
+}
+
+// the original demo: heavy circles tied into a square grid by stiff springs, 15x15 by default
+inline void setupLattice(Scene& scene, uint32_t bodies) {
+    const int side = std::max(2, (int)sqrt((float)bodies));
+    std::vector<Body> grid;
+    for (int i = 0; i < side; i++) for (int j = 0; j < side; j++) {
+        Body body = scene.addCircle(250 + i*30, 250 + j*30, 9, 250);
+        body.setVelocity(sf::Vector2f((float)(scene.rng.next()%100) - 50, (float)(scene.rng.next()%100) - 50));
+        grid.push_back(body);
+    }
+    for (int i = 0; i < side*side - 1; i++) if (i%side != side - 1) scene.addSpring(grid[i], grid[i + 1], 1000, 0.1f);
+    for (int i = 0; i < side*(side - 1); i++) scene.addSpring(grid[i], grid[i + side], 1000, 0.1f);
+}
+
+// weightless circles bouncing around a closed box at roughly a third of the area covered
+inline void setupGas(Scene& scene, uint32_t bodies) {
+    scene.gravity = sf::Vector2f(0, 0); scene.air_resistance = 0;
+    const float side = sqrt((float)bodies)*20;
+    addWalls(scene, side, side);
+    for (uint32_t i = 0; i < bodies; i++) {
+        Body body = scene.addCircle(scene.rng.range(10, side - 10), scene.rng.range(10, side - 10), scene.rng.range(4, 9),
+                                    1 + scene.rng.next()%5);
+        body.setVelocity(sf::Vector2f(scene.rng.range(-30, 30), scene.rng.range(-30, 30)));
+    }
+}
+
+// an empty box under gravity that fills up from the top; every spawn moves the static walls to the end of the arrays
+// again, so this one exercises Bodies::add and the broadphase rebuilds as much as the solver
+inline float pileWidth(uint32_t bodies) {return sqrt((float)bodies)*20;}
+inline void setupPile(Scene& scene, uint32_t bodies) {
+    scene.gravity = sf::Vector2f(0, 500); scene.air_resistance = 0.1f;
+    addWalls(scene, pileWidth(bodies), pileWidth(bodies));
+}
+inline void spawnPile(Scene& scene, uint64_t /*step*/, uint32_t bodies) {
+    const uint32_t per_step = std::max(1u, bodies/1000);
+    const float width = pileWidth(bodies);
+    for (uint32_t k = 0; k < per_step && scene.bodies.end(CIRCLE) < bodies; k++)
+        scene.addCircle(scene.rng.range(10, width - 10), scene.rng.range(10, 60), scene.rng.range(4, 9), 1 + scene.rng.next()%5);
+}
+
+// steady state spawning and despawning: bodies rain in at the top, bounce down a few rows of static shelves and are
+// removed once they drop out of the open bottom, so past the first fall every step both adds and removes bodies
+inline float rainWidth(uint32_t bodies) {return sqrt((float)bodies)*30;}
+inline void setupRain(Scene& scene, uint32_t bodies) {
+    scene.gravity = sf::Vector2f(0, 500); scene.air_resistance = 0.1f;
+    const float width = rainWidth(bodies);
+    scene.reserve(bodies + 64, 0);
+    for (int row = 1; row < 5; row++) for (int k = 0; k < 8; k++)
+        scene.addBox((k + (row%2)*0.5f)*width/8, row*width/5, width/32, 20, 0, true);
+}
+inline void spawnRain(Scene& scene, uint64_t /*step*/, uint32_t bodies) {
+    const float width = rainWidth(bodies);
+    const Bodies& s = scene.bodies;
+    for (uint32_t i = s.begin(CIRCLE); i < s.end(CIRCLE);) {
+        if (s.y[i] > width) scene.removeBody(scene.bodyAt(i)); // the last circle moves into i, look at it next
+        else i++;
+    }
+    const uint32_t per_step = std::max(1u, bodies/200);
+    for (uint32_t k = 0; k < per_step && s.end(CIRCLE) < bodies; k++)
+        scene.addCircle(scene.rng.range(10, width - 10), scene.rng.range(-60, 0), scene.rng.range(4, 9), 1 + scene.rng.next()%5);
+}
+
+const Scenario scenarios[] = {
+    {"lattice", 225, setupLattice, nullptr},
+    {"gas", 10000, setupGas, nullptr},
+    {"pile", 5000, setupPile, spawnPile},
+    {"rain", 5000, setupRain, spawnRain},
+};
+const int SCENARIO_COUNT = sizeof(scenarios)/sizeof(scenarios[0]);
@@ -0,0 +1,270 @@
+#pragma once
+#include "bodies.hpp"
+#include "rng.hpp"
+#include "stages.hpp"
+#include "narrowphase_simd.hpp"
+#include "parallel_narrowphase.hpp"
+#include "aabb_tree.hpp"
+#include "sweep_and_prune.hpp"
+#include "snapshot.hpp"
+#include "springs.hpp"
+#include "xpbd.hpp"
+#include "integrators.hpp"
+#include "islands.hpp"
+#include "morton.hpp"
+#include "recorder.hpp"
+
+struct Scene {
+    Scene(sf::Vector2f gravity = sf::Vector2f(0, 0), float air_resistance = 0.f, bool elastic_collisions = true) {
+        this->gravity = gravity;
+        this->air_resistance = air_resistance;
+    }
+    Bodies bodies;
+    Springs springs;
+    sf::Vector2f gravity;
+    float air_resistance;
+    Rng rng;
+    StageTimer* timer = nullptr; // set to collect per stage timings of update
+    Recorder* recorder = nullptr; // set to capture every step into a trajectory file
+
+    Body body(uint32_t id) {return Body{&bodies, id, bodies.handles.generation[id]};}
+    Body bodyAt(uint32_t slot) {return body(bodies.handles.handle[slot]);}
+    Body addCircle(float x, float y, float radius, float mass = 1.f, bool is_static = false, int8_t group = -1) {
+        return addBody(x, y, radius, radius, mass, is_static, CIRCLE, group);
+    }
+    // x, y is the top left corner like sf::RectangleShape, the box is stored by its centre
+    Body addBox(float x, float y, float width, float height, float mass = 1.f, bool is_static = false, int8_t group = -1) {
+        return addBody(x + width/2, y + height/2, width/2, height/2, mass, is_static, BOX, group);
+    }
+    Spring addSpring(Body a, Body b, float spring_constant, float damping_constant, float rest_length = 0.f) {
+        const uint32_t id = springs.add(a.slot(), b.slot(), spring_constant, damping_constant, rest_length);
+        return Spring{&springs, id, springs.handles.generation[id]};
+    }
+    // removes the body with its springs; stale handles are ignored
+    void removeBody(Body body) {
+        if (!body.valid()) return;
+        const uint32_t slot = body.slot();
+        springs.removeBody(slot);
+        tree.remove(slot);
+        moves.clear();
+        bodies.remove(slot, moves);
+        for (uint32_t i = 0; i < moves.size(); i++) relocate(moves[i].first, moves[i].second);
+    }
+    void removeSpring(Spring spring) {if (spring.valid()) springs.remove(spring.slot());}
+    // room for this many bodies and springs, so spawning up to there does not reallocate the columns
+    void reserve(uint32_t body_count, uint32_t spring_count) {
+        bodies.reserve(body_count); springs.reserve(spring_count);
+        bounds.reserve(body_count); moves.reserve(SHAPE_COUNT);
+        morton.keys.reserve(body_count); morton.order.reserve(body_count); morton.new_slot.reserve(body_count);
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> moves;
+    Body addBody(float x, float y, float half_w, float half_h, float mass, bool is_static, int8_t shape, int8_t group) {
+        moves.clear();
+        const uint32_t id = bodies.add(x, y, half_w, half_h, mass, is_static, shape, group < 0 ? rng.next()%GROUP_COUNT : group, moves);
+        for (uint32_t i = 0; i < moves.size(); i++) relocate(moves[i].first, moves[i].second);
+        return body(id);
+    }
+    // patches everything that refers to bodies by slot after the body in slot from has been moved to slot to
+    void relocate(uint32_t from, uint32_t to) {
+        springs.relocate(from, to);
+        tree.relocate(from, to);
+        sap.reset();
+    }
+
+    BroadphaseMode broadphase = UNIFORM_GRID;
+    UniformGrid grid;
+    AABBTree tree;
+    SweepAndPrune sap;
+    std::vector<AABB> bounds;
+    std::vector<BodyPair> pairs;
+
+    std::vector<BodyPair> pool_pairs[3];
+    CircleBatches circle_batches; // circle_batches.level picks the SIMD width of the overlap test, SIMD_SCALAR runs CCTest alone
+    // with more than one thread the pool pairs are coloured and collided in parallel, the broadphase stays serial
+    ThreadPool thread_pool;
+    PairColouring colouring[3];
+
+    void CollisionHandler() {
+        if (broadphase == BRUTE_FORCE) {
+            StageScope scope(timer, STAGE_NARROWPHASE);
+            collidePools<CIRCLE, CIRCLE>(bodies);
+            collidePools<CIRCLE, BOX>(bodies);
+            collidePools<BOX, BOX>(bodies);
+            return;
+        }
+        {StageScope scope(timer, STAGE_BROADPHASE); findPairs();}
+        StageScope scope(timer, STAGE_NARROWPHASE);
+        if (thread_pool.size() > 1) {
+            for (int k = 0; k < 3; k++) colouring[k].build(pool_pairs[k], bodies.size());
+            collideColoured<CIRCLE, CIRCLE>(bodies, colouring[0], thread_pool);
+            collideColoured<CIRCLE, BOX>(bodies, colouring[1], thread_pool);
+            collideColoured<BOX, BOX>(bodies, colouring[2], thread_pool);
+            return;
+        }
+        circle_batches.collide(bodies, pool_pairs[0]);
+        collidePairs<CIRCLE, BOX>(bodies, pool_pairs[1]);
+        collidePairs<BOX, BOX>(bodies, pool_pairs[2]);
+    }
+
+    // runs the selected broadphase and sorts the candidate pairs into pool_pairs
+    void findPairs() {
+        const uint32_t n = bodies.size();
+        bounds.resize(n);
+        const float* x = bodies.x.data(), * y = bodies.y.data(), * hw = bodies.half_w.data(), * hh = bodies.half_h.data();
+        AABB* box = bounds.data();
+        thread_pool.parallelFor(n, 4096, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) box[i] = {x[i] - hw[i], y[i] - hh[i], x[i] + hw[i], y[i] + hh[i]};
+        });
+        if (broadphase == BRUTE_FORCE) bruteForcePairs(bounds, pairs);
+        else if (broadphase == UNIFORM_GRID) grid.findPairs(bounds, pairs);
+        else if (broadphase == AABB_TREE) tree.findPairs(bounds, pairs);
+        else sap.findPairs(bounds, pairs);
+
+        // pairs come with a < b and circles are stored before boxes, so counting the box slots in a pair gives its
+        // pool pair: 0 circle-circle, 1 circle-box, 2 box-box
+        const uint32_t boxes = bodies.begin(BOX);
+        for (int k = 0; k < 3; k++) pool_pairs[k].clear();
+        // once something sleeps, pairs without an awake moving body have nothing to resolve
+        const uint8_t* flags = bodies.flags.data();
+        for (uint32_t i = 0; i < pairs.size(); i++) {
+            if (islands.sleeping && flags[pairs[i].a] & (STATIC | SLEEPING) && flags[pairs[i].b] & (STATIC | SLEEPING)) continue;
+            pool_pairs[(pairs[i].a >= boxes) + (pairs[i].b >= boxes)].push_back(pairs[i]);
+        }
+    }
+
+    // One pass of an integrator over every moving body: remember the position if save, then kick the velocity by
+    // acceleration*kick and drift the position by velocity*drift. The accelerations are left alone, evaluate()
+    // replaces them.
+    void pass(float kick, float drift, bool save) {
+        StageScope scope(timer, STAGE_INTEGRATE);
+        Bodies& s = bodies;
+        const uint32_t n = s.size();
+        for (uint32_t i = 0; i < n; i++) {
+            if (s.flags[i] & (STATIC | SLEEPING)) continue;
+            if (save) {s.x_old[i] = s.x[i]; s.y_old[i] = s.y[i];}
+            s.vx[i] += s.ax[i]*kick; s.vy[i] += s.ay[i]*kick;
+            s.x[i] += s.vx[i]*drift; s.y[i] += s.vy[i]*drift;
+        }
+    }
+    void clearAccelerations() {
+        std::fill(bodies.ax.begin(), bodies.ax.end(), 0.f);
+        std::fill(bodies.ay.begin(), bodies.ay.end(), 0.f);
+    }
+    // accelerations at the current positions and velocities; anything applied to a body between steps is only seen by
+    // integrators that kick before they first evaluate (euler, velocity verlet, leapfrog)
+    void evaluate() {
+        {StageScope scope(timer, STAGE_INTEGRATE); clearAccelerations();}
+        {StageScope scope(timer, STAGE_SPRINGS); updateSprings();}
+        {StageScope scope(timer, STAGE_FORCES); applyForces();}
+    }
+
+    // see integrators.hpp; staggered is true while leapfrog keeps the velocities half a step behind
+    Integrator integrator = INTEGRATOR_EULER;
+    bool staggered = false;
+    template <class I> void integrateWith(float dt) {I::step(*this, dt);}
+    void integrate(float dt) {
+        if (staggered && integrator != INTEGRATOR_LEAPFROG) {pass(dt/2, 0, false); staggered = false;}
+        switch (integrator) {
+            case INTEGRATOR_EULER: integrateWith<SemiImplicitEuler>(dt); break;
+            case INTEGRATOR_VERLET: integrateWith<PositionVerlet>(dt); break;
+            case INTEGRATOR_VELOCITY_VERLET: integrateWith<VelocityVerlet>(dt); break;
+            case INTEGRATOR_LEAPFROG: integrateWith<Leapfrog>(dt); break;
+            case INTEGRATOR_YOSHIDA: integrateWith<Yoshida4>(dt); break;
+            default: break;
+        }
+    }
+
+    void updateSprings() {springs.apply(bodies, thread_pool);}
+
+    void applyForces() {
+        Bodies& s = bodies;
+        const uint32_t n = s.size();
+        for (uint32_t i = 0; i < n; i++) {
+            s.ax[i] += gravity.x - air_resistance*s.vx[i];
+            s.ay[i] += gravity.y - air_resistance*s.vy[i];
+        }
+    }
+
+    // SOLVER_FORCES is the original explicit step; the XPBD solvers take springs and contacts as constraints, see Xpbd
+    Solver solver = SOLVER_FORCES;
+    Xpbd xpbd;
+    void updateXpbd(float dt) {
+        if (staggered) {pass(dt/2, 0, false); staggered = false;}
+        {StageScope scope(timer, STAGE_FORCES); applyForces();}
+        pass(dt, dt, true);
+        {StageScope scope(timer, STAGE_INTEGRATE); clearAccelerations();}
+        {StageScope scope(timer, STAGE_BROADPHASE); findPairs();}
+        StageScope scope(timer, STAGE_SOLVE);
+        xpbd.solve(bodies, springs, pool_pairs, dt, solver == SOLVER_XPBD_JACOBI, thread_pool);
+    }
+
+    // with allow_sleep resting islands stop costing integration and narrowphase work, see Islands. The islands come
+    // from the broadphase pairs, so brute force keeps everything awake.
+    bool allow_sleep = false;
+    Islands islands;
+    void updateIslands(float dt) {
+        StageScope scope(timer, STAGE_ISLANDS);
+        if (allow_sleep && broadphase != BRUTE_FORCE) islands.update(bodies, springs, pairs, dt);
+        else if (islands.sleeping) islands.wakeAll(bodies);
+    }
+
+    // every morton.interval steps the bodies are re-sorted along a Z-order curve, see MortonOrder; handles, springs and
+    // both incremental broadphases follow them
+    MortonOrder morton;
+    void reorder() {
+        StageScope scope(timer, STAGE_REORDER);
+        morton.build(bodies, thread_pool);
+        bodies.permute(morton.order, thread_pool);
+        springs.reorder(morton.new_slot, morton.radix, thread_pool);
+        tree.remap(morton.new_slot);
+        sap.remap(morton.new_slot);
+    }
+
+    uint64_t steps = 0;
+    void update(float dt) {
+        steps++;
+        if (!allow_sleep || !islands.resting(bodies)) simulate(dt);
+        if (recorder) {StageScope scope(timer, STAGE_RECORD); recorder->capture(bodies, steps);}
+    }
+    void simulate(float dt) {
+        if (morton.interval > 0 && steps%morton.interval == 0) reorder();
+        if (solver != SOLVER_FORCES) {updateXpbd(dt); updateIslands(dt); return;}
+        integrate(dt);
+        CollisionHandler();
+        updateIslands(dt);
+    }
+
+    // Fixed timestep driver: frame time goes into the accumulator and is paid out in steps of exactly step seconds, so
+    // the springs always see the same dt however the frames come in. A frame never runs more than max_steps steps;
+    // after a hitch the simulation falls behind instead of trying to catch up and making the next frame even longer.
+    // alpha is how far real time has got between the last two simulated states, the renderer blends x_old to x by it.
+    float step = 1.f/480, accumulator = 0, alpha = 1;
+    int max_steps = 24;
+    void setTimestep(float frame_dt, int sub_steps) {step = frame_dt/sub_steps; max_steps = 3*sub_steps;}
+    int advance(float frame_dt) {
+        accumulator += frame_dt;
+        int steps = 0;
+        for (; accumulator >= step && steps < max_steps; steps++) {update(step); accumulator -= step;}
+        if (accumulator >= step) accumulator = 0;
+        alpha = accumulator/step;
+        return steps;
+    }
+
+    // copies out what the renderer draws; the vectors of out keep their capacity, so this stops allocating once the
+    // scene stops growing
+    void snapshot(Snapshot& out) const {
+        const Bodies& s = bodies;
+        out.x.assign(s.x.begin(), s.x.end()); out.y.assign(s.y.begin(), s.y.end());
+        out.x_old.assign(s.x_old.begin(), s.x_old.end()); out.y_old.assign(s.y_old.begin(), s.y_old.end());
+        out.half_w.assign(s.half_w.begin(), s.half_w.end()); out.half_h.assign(s.half_h.begin(), s.half_h.end());
+        out.group.assign(s.group.begin(), s.group.end());
+        out.spring_a.assign(springs.a.begin(), springs.a.end()); out.spring_b.assign(springs.b.begin(), springs.b.end());
+        for (int k = 0; k <= SHAPE_COUNT; k++) out.pool[k] = s.pool[k];
+        out.alpha = alpha; out.steps = steps;
+        out.broadphase = broadphase; out.solver = solver; out.integrator = integrator;
+        out.sleeping = islands.sleeping;
+        out.narrowphase = thread_pool.size() > 1 ? -1 : circle_batches.level;
+        out.threads = thread_pool.size();
+    }
+};
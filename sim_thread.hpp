@@ -0,0 +1,65 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <chrono>
+#include "scene.hpp"
+
+// Owns the simulation side of the app. tick applies the queued commands, advances the scene by the frame time and
+// publishes a Snapshot; the renderer only ever reads snapshots, so the same loop works with the simulation running
+// inline on the render thread or on a thread of its own. start moves it onto its own thread, paced by its own clock,
+// so vsync or a slow frame no longer holds back the steps per second.
+struct SimThread {
+    SimThread(Scene* scene) {this->scene = scene;}
+    ~SimThread() {stop();}
+    Scene* scene;
+    TripleBuffer<Snapshot> snapshots;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::mutex mutex;
+    std::vector<std::function<void(Scene&)>> commands, pending; // commands waiting for the simulation side
+
+    bool threaded() const {return running;}
+
+    // changes to the scene from the render side; applied before the next advance
+    void post(std::function<void(Scene&)> command) {
+        std::lock_guard<std::mutex> lock(mutex);
+        commands.push_back(std::move(command));
+    }
+
+    // returns whether anything changed, that is whether a new snapshot went out
+    bool tick(float frame_dt) {
+        {std::lock_guard<std::mutex> lock(mutex); pending.swap(commands);}
+        const bool changed = !pending.empty();
+        for (uint32_t i = 0; i < pending.size(); i++) pending[i](*scene);
+        pending.clear();
+        if (scene->advance(frame_dt) == 0 && !changed) return false;
+        publish();
+        return true;
+    }
+    void publish() {
+        scene->snapshot(snapshots.writeSlot());
+        snapshots.publish();
+    }
+
+    void start() {
+        if (running) return;
+        running = true;
+        thread = std::thread([this] {
+            typedef std::chrono::steady_clock Clock;
+            Clock::time_point last = Clock::now();
+            while (running) {
+                const Clock::time_point now = Clock::now();
+                const float dt = std::chrono::duration<float>(now - last).count();
+                last = now;
+                // nothing to do until the accumulator holds another step
+                if (!tick(dt)) std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        });
+    }
+    void stop() {
+        if (!running) return;
+        running = false;
+        thread.join();
+    }
+};
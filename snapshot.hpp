@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include "bodies.hpp"
+
+// Everything the renderer needs from one simulated frame, copied out of the Scene so it can be drawn while the
+// simulation already works on the next steps. Positions are kept for the last two steps together with the blend
+// factor of Scene::advance, so drawing a snapshot interpolates exactly like drawing the live scene did.
+struct Snapshot {
+    std::vector<float> x, y, x_old, y_old, half_w, half_h;
+    std::vector<int8_t> group;
+    std::vector<uint32_t> spring_a, spring_b; // slots into the arrays above
+    uint32_t pool[SHAPE_COUNT + 1] = {};
+    float alpha = 1;
+    uint64_t steps = 0;
+    // settings of the scene at the time, for the overlay
+    int broadphase = 0, narrowphase = 0, solver = 0, integrator = 0;
+    unsigned threads = 1;
+    uint32_t sleeping = 0;
+
+    uint32_t begin(int shape) const {return pool[shape];}
+    uint32_t end(int shape) const {return pool[shape + 1];}
+};
+
+// Lock free single producer single consumer triple buffer. The writer fills its back slot and swaps it with the middle
+// one, the reader swaps the middle slot for its front slot whenever a new one has been published. Neither side ever
+// waits; the writer can overwrite an unread middle slot, the reader then simply gets the newer one.
+template <class T> struct TripleBuffer {
+    static constexpr uint32_t FRESH = 4; // set in middle while it holds a publish the reader has not taken yet
+    T slots[3];
+    std::atomic<uint32_t> middle{1};
+    uint32_t back = 0, front = 2;
+
+    T& writeSlot() {return slots[back];}
+    void publish() {back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & 3;}
+    // the newest published value, or the same as last time if nothing new came in
+    const T& read() {
+        if (middle.load(std::memory_order_relaxed) & FRESH) front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+        return slots[front];
+    }
+};
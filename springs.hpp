@@ -0,0 +1,178 @@
+#pragma once
+#include "bodies.hpp"
+#include "thread_pool.hpp"
+#include "adjacency.hpp"
+#include "radix_sort.hpp"
+
+// Springs as a structure of arrays. The force pass is split in two so neither half has scattered writes: the first
+// loop gathers both end positions and writes one force per spring into fx/fy, the second walks the springs of every
+// body through a CSR adjacency and sums their forces before touching its acceleration once. Both loops are plain
+// streams over contiguous arrays, parallel over springs and bodies respectively, and the sums per body always run in
+// spring order, so the result does not depend on the thread count. A pool without workers runs the fused
+// gather/compute/scatter loop instead, in the order of the original pass. Springs between two sleeping bodies are
+// skipped, they pull on nothing that moves. Springs are handed out through generational Handles like bodies and removed
+// by moving the last spring into the gap.
+//
+// Every body also keeps a linked list of the spring ends attached to it, kept up to date by add and remove, so moving
+// or removing a body only visits its own springs rather than all of them. The lists are keyed like the adjacency, an
+// end is spring*2 + 1 for end b and spring*2 for end a.
+struct Springs {
+    std::vector<uint32_t> a, b; // body slots
+    std::vector<float> stiffness, damping, rest_length;
+    std::vector<float> fx, fy; // force on end b from the last update, end a gets the opposite
+    Adjacency adjacency;
+    Handles handles;
+    bool dirty = true;
+    std::vector<uint32_t> keys, order; // reorder scratch
+    static constexpr uint32_t NONE = ~0u;
+    std::vector<uint32_t> first, next; // per body list of attached ends: first by body slot, next by end
+
+    uint32_t size() const {return a.size();}
+    uint32_t end(uint32_t e) const {return e & 1 ? b[e >> 1] : a[e >> 1];}
+    uint32_t add(uint32_t a, uint32_t b, float stiffness, float damping, float rest_length) {
+        this->a.push_back(a); this->b.push_back(b);
+        this->stiffness.push_back(stiffness); this->damping.push_back(damping); this->rest_length.push_back(rest_length);
+        handles.handle.push_back(0);
+        if (std::max(a, b) >= first.size()) first.resize(std::max(a, b) + 1, NONE);
+        const uint32_t i = size() - 1;
+        next.push_back(first[a]); first[a] = 2*i;
+        next.push_back(first[b]); first[b] = 2*i + 1;
+        dirty = true;
+        return handles.create(i);
+    }
+    void remove(uint32_t i) {
+        handles.destroy(i);
+        unlink(2*i); unlink(2*i + 1);
+        const uint32_t last = size() - 1;
+        if (i != last) {
+            a[i] = a[last]; b[i] = b[last];
+            stiffness[i] = stiffness[last]; damping[i] = damping[last]; rest_length[i] = rest_length[last];
+            handles.move(last, i);
+            rename(2*last, 2*i); rename(2*last + 1, 2*i + 1);
+        }
+        a.pop_back(); b.pop_back(); stiffness.pop_back(); damping.pop_back(); rest_length.pop_back(); handles.handle.pop_back();
+        next.pop_back(); next.pop_back();
+        dirty = true;
+    }
+    // the link pointing at end e in the list of its body
+    uint32_t* linkTo(uint32_t e, uint32_t body) {
+        uint32_t* link = &first[body];
+        while (*link != e) link = &next[*link];
+        return link;
+    }
+    void unlink(uint32_t e) {*linkTo(e, end(e)) = next[e];}
+    // end from takes the place of end to in its list; the spring has already been moved, so end(to) is its body
+    void rename(uint32_t from, uint32_t to) {
+        *linkTo(from, end(to)) = to;
+        next[to] = next[from];
+    }
+    // every spring attached to the body in slot, each removal takes the head of its list
+    void removeBody(uint32_t slot) {
+        while (slot < first.size() && first[slot] != NONE) remove(first[slot] >> 1);
+    }
+    // rebuilds the lists after a and b were rewritten wholesale
+    void relink() {
+        uint32_t bodies = first.size();
+        for (uint32_t i = 0; i < size(); i++) bodies = std::max(bodies, std::max(a[i], b[i]) + 1);
+        first.assign(bodies, NONE);
+        next.resize(2*size());
+        for (uint32_t e = 2*size(); e-- > 0;) {next[e] = first[end(e)]; first[end(e)] = e;}
+    }
+    // after the bodies have been permuted: moves the ends to their new slots and sorts the springs by their lower end,
+    // so the spring pass walks the bodies in the same order as everything else
+    void reorder(const std::vector<uint32_t>& new_slot, RadixSort& radix, ThreadPool& pool) {
+        const uint32_t n = size();
+        keys.resize(n); order.resize(n);
+        for (uint32_t i = 0; i < n; i++) {
+            a[i] = new_slot[a[i]]; b[i] = new_slot[b[i]];
+            keys[i] = std::min(a[i], b[i]); order[i] = i;
+        }
+        radix.sort(keys.data(), order.data(), n, pool);
+        std::vector<float>& float_scratch = fx; // fx/fy are rewritten on the next apply anyway
+        for (std::vector<float>* column : {&stiffness, &damping, &rest_length}) Bodies::gather(*column, order, float_scratch, pool);
+        std::vector<uint32_t>& uint32_scratch = keys;
+        for (std::vector<uint32_t>* column : {&a, &b, &handles.handle}) Bodies::gather(*column, order, uint32_scratch, pool);
+        for (uint32_t i = 0; i < n; i++) handles.index[handles.handle[i]] = i;
+        relink();
+        dirty = true;
+    }
+    void reserve(uint32_t n) {
+        a.reserve(n); b.reserve(n); stiffness.reserve(n); damping.reserve(n); rest_length.reserve(n);
+        fx.reserve(n); fy.reserve(n); handles.reserve(n); next.reserve(2*n);
+    }
+    // the body in slot from moved to slot to, which held no springs; only its own springs are visited
+    void relocate(uint32_t from, uint32_t to) {
+        const uint32_t head = from < first.size() ? first[from] : NONE;
+        if (head == NONE) {if (to < first.size()) first[to] = NONE; return;}
+        first[from] = NONE;
+        if (to >= first.size()) first.resize(to + 1, NONE);
+        first[to] = head;
+        for (uint32_t e = head; e != NONE; e = next[e]) (e & 1 ? b : a)[e >> 1] = to;
+        dirty = true;
+    }
+
+    void buildAdjacency(uint32_t bodies) {
+        adjacency.build(a.data(), b.data(), size(), bodies);
+        fx.resize(size()); fy.resize(size());
+        dirty = false;
+    }
+    bool adjacencyValid(uint32_t bodies) const {return !dirty && adjacency.offsets.size() == bodies + 1;}
+
+    // Hooke's law around rest_length; with the default rest length of 0 this is the plain -k*d pull of the original
+    // springs. damping is stored for the constraint solvers, the explicit force does not use it.
+    static float scale(float dx, float dy, float k, float rest) {
+        // rest length 0 pulls with -k*d and needs no square root
+        return rest > 0 ? k*(rest/sqrt(dx*dx + dy*dy) - 1) : -k;
+    }
+
+    void apply(Bodies& s, ThreadPool& pool) {
+        const uint32_t n = size(), bodies = s.size();
+        if (n == 0) return;
+        const uint32_t* ia = a.data(), * ib = b.data();
+        const float* x = s.x.data(), * y = s.y.data(), * k = stiffness.data(), * rest = rest_length.data();
+        const float* inv_mass = s.inv_mass.data();
+        const uint8_t* flags = s.flags.data();
+        float* ax = s.ax.data(), * ay = s.ay.data();
+        // on one thread the round trip through fx/fy costs more than the scattered adds it avoids
+        if (pool.size() == 1) {
+            for (uint32_t i = 0; i < n; i++) {
+                const uint32_t p = ia[i], q = ib[i];
+                if (flags[p] & flags[q] & SLEEPING) continue;
+                const float dx = x[q] - x[p], dy = y[q] - y[p], f = scale(dx, dy, k[i], rest[i]);
+                ax[p] -= f*dx*inv_mass[p]; ay[p] -= f*dy*inv_mass[p];
+                ax[q] += f*dx*inv_mass[q]; ay[q] += f*dy*inv_mass[q];
+            }
+            return;
+        }
+        if (!adjacencyValid(bodies)) buildAdjacency(bodies);
+        float* force_x = fx.data(), * force_y = fy.data();
+        pool.parallelFor(n, 8192, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                if (flags[ia[i]] & flags[ib[i]] & SLEEPING) {force_x[i] = force_y[i] = 0; continue;}
+                const float dx = x[ib[i]] - x[ia[i]], dy = y[ib[i]] - y[ia[i]], f = scale(dx, dy, k[i], rest[i]);
+                force_x[i] = f*dx; force_y[i] = f*dy;
+            }
+        });
+        const uint32_t* first = adjacency.offsets.data(), * list = adjacency.ends.data();
+        pool.parallelFor(bodies, 8192, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                if (first[i] == first[i + 1]) continue;
+                float sx = 0, sy = 0;
+                for (uint32_t e = first[i]; e < first[i + 1]; e++) {
+                    const uint32_t spring = list[e] >> 1;
+                    const float sign = list[e] & 1 ? 1.f : -1.f;
+                    sx += sign*force_x[spring]; sy += sign*force_y[spring];
+                }
+                ax[i] += sx*inv_mass[i]; ay[i] += sy*inv_mass[i];
+            }
+        });
+    }
+};
+
+// handle to a spring, valid() tells whether it has been removed
+struct Spring {
+    Springs* springs; uint32_t id, generation;
+
+    bool valid() const {return springs->handles.valid(id, generation);}
+    uint32_t slot() const {return springs->handles.index[id];}
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <chrono>
+#include "profiler.hpp"
+#include "perf_counters.hpp"
+
+enum Stage {STAGE_INTEGRATE, STAGE_SPRINGS, STAGE_FORCES, STAGE_BROADPHASE, STAGE_NARROWPHASE, STAGE_SOLVE, STAGE_ISLANDS,
+            STAGE_REORDER, STAGE_RECORD, STAGE_COUNT};
+const char* const stage_names[] = {"integrate", "springs", "forces", "broadphase", "narrowphase", "solve", "islands", "reorder",
+                                   "record"};
+
+// the hardware events counted per stage, see StageTimer::counters
+const PerfEvent stage_events[] = {PERF_CYCLES, PERF_INSTRUCTIONS, PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_BRANCH_MISSES};
+const int STAGE_EVENT_COUNT = sizeof(stage_events)/sizeof(stage_events[0]);
+
+// Accumulated wall time per stage of Scene::update. Scene only times its stages while Scene::timer points at one of
+// these, otherwise a StageScope costs a null check. Built with PHYSICS_PROFILE, every StageScope is also a trace scope
+// named after its stage, timer or not.
+//
+// When counters also points at a started group of stage_events, every stage reads it on entry and exit, two system
+// calls, and adds up the counts. They cover the thread running update only, so run single threaded to see all of a
+// parallel stage.
+struct StageTimer {
+    double seconds[STAGE_COUNT] = {};
+    PerfGroup* counters = nullptr;
+    double events[STAGE_COUNT][STAGE_EVENT_COUNT] = {};
+    void reset() {
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            seconds[i] = 0;
+            for (int e = 0; e < STAGE_EVENT_COUNT; e++) events[i][e] = 0;
+        }
+    }
+};
+
+struct StageScope {
+    typedef std::chrono::steady_clock Clock;
+    StageTimer* timer; Stage stage; Clock::time_point start;
+    PerfGroup::Sample sample = {};
+#ifdef PHYSICS_PROFILE
+    TraceScope trace;
+#endif
+    StageScope(StageTimer* timer, Stage stage) {
+        this->timer = timer; this->stage = stage;
+        if (timer && timer->counters) timer->counters->read(sample);
+        if (timer) start = Clock::now();
+#ifdef PHYSICS_PROFILE
+        trace.start(stage_names[stage]);
+#endif
+    }
+    ~StageScope() {
+        if (!timer) return;
+        timer->seconds[stage] += std::chrono::duration<double>(Clock::now() - start).count();
+        if (!timer->counters) return;
+        PerfGroup::Sample end;
+        timer->counters->read(end);
+        // scaled up for the share of the stage the group was not scheduled, if the PMU was shared with other events
+        const uint64_t running = end.running - sample.running, enabled = end.enabled - sample.enabled;
+        if (running == 0) return;
+        for (int e = 0; e < STAGE_EVENT_COUNT; e++) timer->events[stage][e] += (double)(end.values[e] - sample.values[e])*enabled/running;
+    }
+};
@@ -0,0 +1,164 @@
+#pragma once
+#include "broadphase.hpp"
+#include <iterator>
+
+// Persistent sweep and prune on both axes. The endpoint arrays survive between steps and are re-sorted with insertion
+// sort, which is close to linear because bodies barely move from one step to the next. Every swap of a min endpoint
+// with a max endpoint is an overlap starting or ending on that axis, so the pair set is maintained incrementally and
+// the pairs gained and lost during the last update are available in added/removed.
+struct SweepAndPrune {
+    struct Endpoint {
+        float value;
+        uint32_t body; // top bit set for max endpoints
+        bool isMax() const {return body & MAX_BIT;}
+        uint32_t id() const {return body & ~MAX_BIT;}
+        // touching boxes count as overlapping, so at equal values min endpoints sort before max endpoints
+        bool operator<(const Endpoint& o) const {return value < o.value || (value == o.value && !isMax() && o.isMax());}
+    };
+    static constexpr uint32_t MAX_BIT = 0x80000000u, EMPTY = 0xffffffffu;
+    std::vector<Endpoint> axis[2];
+    std::vector<BodyPair> pairs, added, removed;
+    std::vector<BodyPair> previous, current; // rebuild scratch, kept so rebuilding does not allocate once warmed up
+    std::vector<uint32_t> table, active, active_slot; // open addressing pair hash -> index into pairs
+    uint32_t bodies = 0;
+
+    void findPairs(const std::vector<AABB>& bounds, std::vector<BodyPair>& out) {
+        update(bounds);
+        out.assign(pairs.begin(), pairs.end());
+    }
+
+    // forgets the body ids held in the endpoint arrays; the next update rebuilds and reports every pair as added
+    void reset() {bodies = 0; pairs.clear();}
+
+    // the bodies have been permuted, body i now lives in slot new_slot[i]. The endpoint order does not change, so the
+    // arrays and the pair set only get their ids renamed instead of a rebuild; a structure that is already behind the
+    // bodies (spawns not seen yet, reset) starts over.
+    void remap(const std::vector<uint32_t>& new_slot) {
+        if (bodies != new_slot.size()) {reset(); return;}
+        for (int k = 0; k < 2; k++)
+            for (uint32_t i = 0; i < axis[k].size(); i++) axis[k][i].body = new_slot[axis[k][i].id()] | (axis[k][i].body & MAX_BIT);
+        for (uint32_t i = 0; i < pairs.size(); i++) {
+            const uint32_t a = new_slot[pairs[i].a], b = new_slot[pairs[i].b];
+            pairs[i] = {std::min(a, b), std::max(a, b)};
+        }
+        rehash(table.size());
+    }
+
+    void update(const std::vector<AABB>& bounds) {
+        added.clear(); removed.clear();
+        const uint32_t n = bounds.size();
+        // appending a few spawned bodies and letting insertion sort carry them into place is cheap, loading a whole
+        // scene that way would be quadratic
+        if (n < bodies || n - bodies > bodies/8) {rebuild(bounds); return;}
+        for (uint32_t i = bodies; i < n; i++) for (int k = 0; k < 2; k++) {
+            axis[k].push_back({0, i}); axis[k].push_back({0, i | MAX_BIT});
+        }
+        bodies = n;
+        for (int k = 0; k < 2; k++) {
+            std::vector<Endpoint>& e = axis[k];
+            for (uint32_t i = 0; i < e.size(); i++) e[i].value = value(bounds[e[i].id()], k, e[i].isMax());
+            for (uint32_t i = 1; i < e.size(); i++) {
+                const Endpoint moving = e[i];
+                uint32_t j = i;
+                for (; j > 0 && moving < e[j - 1]; j--) {
+                    const Endpoint& passed = e[j - 1];
+                    if (!moving.isMax() && passed.isMax()) {
+                        if (bounds[moving.id()].overlaps(bounds[passed.id()])) insert(moving.id(), passed.id());
+                    } else if (moving.isMax() && !passed.isMax()) removePair(moving.id(), passed.id());
+                    e[j] = passed;
+                }
+                e[j] = moving;
+            }
+        }
+    }
+
+    // full sort followed by a single sweep along x, used for the first update and for bulk insertions
+    void rebuild(const std::vector<AABB>& bounds) {
+        const uint32_t n = bounds.size();
+        for (int k = 0; k < 2; k++) {
+            axis[k].resize(2*n);
+            for (uint32_t i = 0; i < n; i++) {
+                axis[k][2*i] = {value(bounds[i], k, false), i};
+                axis[k][2*i + 1] = {value(bounds[i], k, true), i | MAX_BIT};
+            }
+            std::sort(axis[k].begin(), axis[k].end());
+        }
+        previous.swap(pairs); pairs.clear();
+        table.assign(capacity(previous.size()), EMPTY);
+        active.clear(); active_slot.assign(n, 0);
+        for (uint32_t i = 0; i < 2*n; i++) {
+            const Endpoint& e = axis[0][i];
+            if (e.isMax()) {
+                const uint32_t slot = active_slot[e.id()];
+                active[slot] = active.back(); active_slot[active[slot]] = slot; active.pop_back();
+                continue;
+            }
+            for (uint32_t j = 0; j < active.size(); j++) if (bounds[e.id()].overlaps(bounds[active[j]])) insert(e.id(), active[j]);
+            active_slot[e.id()] = active.size(); active.push_back(e.id());
+        }
+        // report the difference to the pair set from before the rebuild
+        auto less = [](const BodyPair& p, const BodyPair& q) {return p.a < q.a || (p.a == q.a && p.b < q.b);};
+        current.assign(pairs.begin(), pairs.end());
+        std::sort(previous.begin(), previous.end(), less); std::sort(current.begin(), current.end(), less);
+        added.clear();
+        std::set_difference(current.begin(), current.end(), previous.begin(), previous.end(), std::back_inserter(added), less);
+        std::set_difference(previous.begin(), previous.end(), current.begin(), current.end(), std::back_inserter(removed), less);
+        bodies = n;
+    }
+
+    static float value(const AABB& b, int k, bool max) {return k == 0 ? (max ? b.max_x : b.min_x) : (max ? b.max_y : b.min_y);}
+
+    static uint32_t capacity(size_t pairs) {
+        uint32_t size = 64;
+        while (size < 2*pairs) size *= 2;
+        return size;
+    }
+    static uint32_t hash(uint32_t a, uint32_t b) {
+        uint64_t key = ((uint64_t)a << 32 | b)*0x9E3779B97F4A7C15ull;
+        return key >> 32;
+    }
+    uint32_t find(uint32_t a, uint32_t b) const {
+        if (a > b) std::swap(a, b);
+        const uint32_t mask = table.size() - 1;
+        for (uint32_t h = hash(a, b) & mask; table[h] != EMPTY; h = (h + 1) & mask)
+            if (pairs[table[h]].a == a && pairs[table[h]].b == b) return h;
+        return EMPTY;
+    }
+    void insert(uint32_t a, uint32_t b) {
+        if (a > b) std::swap(a, b);
+        if (4*(pairs.size() + 1) > 3*table.size()) grow();
+        const uint32_t mask = table.size() - 1;
+        uint32_t h = hash(a, b) & mask;
+        for (; table[h] != EMPTY; h = (h + 1) & mask) if (pairs[table[h]].a == a && pairs[table[h]].b == b) return;
+        table[h] = pairs.size();
+        pairs.push_back({a, b}); added.push_back({a, b});
+    }
+    void removePair(uint32_t a, uint32_t b) {
+        uint32_t h = find(a, b);
+        if (h == EMPTY) return;
+        const uint32_t index = table[h], mask = table.size() - 1;
+        removed.push_back(pairs[index]);
+        // move the last pair into the hole and point its table entry at the new index
+        if (index != pairs.size() - 1) {
+            table[find(pairs.back().a, pairs.back().b)] = index;
+            pairs[index] = pairs.back();
+        }
+        pairs.pop_back();
+        // backward shift deletion keeps linear probing chains intact without tombstones
+        for (uint32_t next = (h + 1) & mask; table[next] != EMPTY; next = (next + 1) & mask) {
+            const uint32_t home = hash(pairs[table[next]].a, pairs[table[next]].b) & mask;
+            if (((next - home) & mask) >= ((next - h) & mask)) {table[h] = table[next]; h = next;}
+        }
+        table[h] = EMPTY;
+    }
+    void grow() {rehash(2*table.size());}
+    void rehash(uint32_t size) {
+        table.assign(size, EMPTY);
+        const uint32_t mask = table.size() - 1;
+        for (uint32_t i = 0; i < pairs.size(); i++) {
+            uint32_t h = hash(pairs[i].a, pairs[i].b) & mask;
+            while (table[h] != EMPTY) h = (h + 1) & mask;
+            table[h] = i;
+        }
+    }
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "profiler.hpp"
+
+// Fixed set of worker threads for data parallel loops. parallelFor hands out chunks of an index range through an atomic
+// counter, the calling thread works along and the call returns once every chunk is done. The collision stage issues a
+// parallelFor per colour, several hundred per frame, so idle workers spin for a while before they go to sleep.
+struct ThreadPool {
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::atomic<uint32_t> generation{0}, next{0}, busy{0};
+    std::atomic<bool> quit{false};
+    // the current job, a type erased pointer to the caller's function object; only written while no job is running
+    void (*call)(const void*, uint32_t, uint32_t) = nullptr;
+    const void* context = nullptr;
+    uint32_t count = 0, grain = 1;
+
+    explicit ThreadPool(unsigned threads = 1) {resize(threads);}
+    ~ThreadPool() {resize(1);}
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // number of threads taking part in a parallelFor, the calling thread included
+    unsigned size() const {return workers.size() + 1;}
+    void resize(unsigned threads) {
+        if (threads < 1) threads = 1;
+        if (threads == size()) return;
+        {std::lock_guard<std::mutex> lock(mutex); quit = true;}
+        wake.notify_all();
+        for (uint32_t i = 0; i < workers.size(); i++) workers[i].join();
+        workers.clear();
+        quit = false;
+        // read here rather than by the workers themselves: a worker that starts after the next parallelFor has already
+        // begun would otherwise take that job for one it has seen, and the caller would wait on it forever
+        const uint32_t seen = generation.load(std::memory_order_acquire);
+        for (unsigned i = 1; i < threads; i++) workers.emplace_back([this, seen] {work(seen);});
+    }
+
+    // runs fn(begin, end) over [0, count) in chunks of at most grain indices
+    template <class F> void parallelFor(uint32_t count, uint32_t grain, const F& fn) {
+        if (count == 0) return;
+        if (workers.empty() || count <= grain) {fn(0, count); return;}
+        call = [](const void* f, uint32_t begin, uint32_t end) {(*(const F*)f)(begin, end);};
+        context = &fn;
+        this->count = count; this->grain = grain;
+        next.store(0, std::memory_order_relaxed);
+        busy.store(workers.size(), std::memory_order_relaxed);
+        {std::lock_guard<std::mutex> lock(mutex); generation.fetch_add(1, std::memory_order_release);}
+        wake.notify_all();
+        runChunks();
+        while (busy.load(std::memory_order_acquire)) std::this_thread::yield();
+    }
+
+    void runChunks() {
+        PROFILE_SCOPE("parallel_for");
+        for (uint32_t begin = next.fetch_add(grain); begin < count; begin = next.fetch_add(grain))
+            call(context, begin, std::min(begin + grain, count));
+    }
+
+    void work(uint32_t seen) {
+        while (true) {
+            for (int spin = 0; spin < 4096 && generation.load(std::memory_order_acquire) == seen && !quit; spin++)
+                std::this_thread::yield();
+            if (generation.load(std::memory_order_acquire) == seen) {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] {return quit || generation.load(std::memory_order_acquire) != seen;});
+            }
+            if (quit) return;
+            seen = generation.load(std::memory_order_acquire);
+            runChunks();
+            busy.fetch_sub(1, std::memory_order_release);
+        }
+    }
+};
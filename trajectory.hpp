@@ -0,0 +1,120 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include "bodies.hpp"
+
+// Trajectory files hold every recorded step of a run, written by Recorder and read by TrajectoryPlayer.
+//
+// A file is a TrajectoryHeader, the chunks, and at the end an index and a TrajectoryTrailer. A chunk is a ChunkHeader
+// followed by up to keyframe_interval encoded frames. The first frame of a chunk is the keyframe and every later one
+// is stored against the frame before it, so any frame decodes from the start of its chunk.
+//
+// A frame lists the bodies by handle id rather than by slot, so removals and reorders do not show up as changes.
+// Removed or never used ids carry tag 0. Each body has five 16 bit columns:
+// - the tag, which is 1 + shape + SHAPE_COUNT*group, so a frame with a tag above SHAPE_COUNT*GROUP_COUNT is damaged;
+// - x and y, quantized to offsets within the chunk's box;
+// - half_w and half_h, in the same units and rounded up.
+// Each column is stored as the difference to the previous frame, wrapped to 16 bits and zigzag coded. Non zero
+// differences are written as varints, and runs of zeros as a 0 followed by the run length, so still bodies and
+// unchanged sizes cost next to nothing. That coding is all the compression there is; a chunk is not run through a
+// general purpose compressor afterwards.
+//
+// The index has one ChunkEntry per chunk and then the chunk number of every frame, so a frame is found without a
+// search. Everything is stored in the host's byte order and layout, which the header's byte_order records; a file
+// only opens on a machine of the same byte order.
+const uint32_t TRAJECTORY_VERSION = 1, CHUNK_MAGIC = 0x4b4e4843; // "CHNK"
+
+enum TrajectoryColumn {TRAJ_TAG, TRAJ_X, TRAJ_Y, TRAJ_HALF_W, TRAJ_HALF_H, TRAJ_COLUMNS};
+
+struct TrajectoryHeader {char magic[8]; uint32_t version, byte_order, keyframe_interval, reserved;};
+// a chunk's positions are min + q*scale, its sizes q*scale
+struct ChunkHeader {uint32_t magic, frames, bytes, reserved; uint64_t first_frame; float min_x, min_y, scale, pad;};
+struct ChunkEntry {uint64_t offset, first_frame; uint32_t frames, bytes;}; // offset of the ChunkHeader
+struct TrajectoryTrailer {uint64_t index_offset, chunks, frames; char magic[8];};
+
+// one decoded frame: column k of body id is values[k][id]
+struct TrajectoryFrame {
+    uint64_t step = 0;
+    uint32_t ids = 0;
+    std::vector<uint16_t> values[TRAJ_COLUMNS];
+
+    void resize(uint32_t n) {ids = n; for (int k = 0; k < TRAJ_COLUMNS; k++) values[k].resize(n);}
+    bool present(uint32_t id) const {return values[TRAJ_TAG][id] != 0;}
+    int shape(uint32_t id) const {return (values[TRAJ_TAG][id] - 1)%SHAPE_COUNT;}
+    int group(uint32_t id) const {return (values[TRAJ_TAG][id] - 1)/SHAPE_COUNT;}
+    static uint16_t tag(int shape, int group) {return 1 + shape + SHAPE_COUNT*group;}
+    static const uint16_t MAX_TAG = SHAPE_COUNT*GROUP_COUNT;
+};
+
+inline void putVarint(std::vector<uint8_t>& out, uint64_t v) {
+    for (; v >= 0x80; v >>= 7) out.push_back((uint8_t)(v | 0x80));
+    out.push_back((uint8_t)v);
+}
+// stops at end; a varint cut off there reads as whatever bits it had
+inline uint64_t getVarint(const uint8_t*& in, const uint8_t* end) {
+    uint64_t v = 0;
+    for (int shift = 0; in < end && shift < 64; shift += 7) {
+        const uint8_t byte = *in++;
+        v |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    return v;
+}
+
+// Encodes and decodes the frames of one chunk, each against the one before; reset at every keyframe.
+struct FrameCodec {
+    TrajectoryFrame previous;
+
+    void reset() {previous.step = 0; previous.resize(0);}
+
+    void encode(const TrajectoryFrame& f, std::vector<uint8_t>& out) {
+        putVarint(out, f.step - previous.step);
+        putVarint(out, f.ids);
+        for (int k = 0; k < TRAJ_COLUMNS; k++) {
+            const uint16_t* cur = f.values[k].data(), * prev = previous.values[k].data();
+            const uint32_t shared = std::min(f.ids, previous.ids);
+            uint32_t run = 0;
+            for (uint32_t id = 0; id < f.ids; id++) {
+                const uint16_t delta = cur[id] - (id < shared ? prev[id] : 0);
+                const uint32_t z = (uint16_t)(delta << 1 ^ -(delta >> 15));
+                if (z == 0) {run++; continue;}
+                if (run) {putVarint(out, 0); putVarint(out, run); run = 0;}
+                putVarint(out, z);
+            }
+            if (run) {putVarint(out, 0); putVarint(out, run);}
+        }
+        previous.step = f.step; previous.ids = f.ids;
+        for (int k = 0; k < TRAJ_COLUMNS; k++) previous.values[k].assign(f.values[k].begin(), f.values[k].end());
+    }
+
+    // false if the bytes do not make up a frame, or make up one with a tag beyond the last shape and group
+    bool decode(const uint8_t*& in, const uint8_t* end, TrajectoryFrame& f) {
+        f.step = previous.step + getVarint(in, end);
+        const uint64_t ids = getVarint(in, end);
+        if (ids > 1u << 26) return false; // far beyond any scene, keeps a damaged file from asking for gigabytes
+        f.resize(ids);
+        for (int k = 0; k < TRAJ_COLUMNS; k++) {
+            uint16_t* cur = f.values[k].data();
+            const uint16_t* prev = previous.values[k].data();
+            const uint32_t shared = std::min(f.ids, previous.ids);
+            for (uint32_t id = 0; id < f.ids;) {
+                if (in >= end) return false;
+                const uint32_t z = getVarint(in, end);
+                if (z == 0) {
+                    const uint64_t run = getVarint(in, end);
+                    if (run == 0 || run > f.ids - id) return false;
+                    for (const uint32_t stop = id + run; id < stop; id++) cur[id] = id < shared ? prev[id] : 0;
+                    continue;
+                }
+                const int16_t delta = (int16_t)(z >> 1 ^ -(int32_t)(z & 1));
+                cur[id] = (uint16_t)((id < shared ? prev[id] : 0) + delta);
+                id++;
+            }
+        }
+        for (uint32_t id = 0; id < f.ids; id++) if (f.values[TRAJ_TAG][id] > TrajectoryFrame::MAX_TAG) return false;
+        previous.step = f.step; previous.ids = f.ids;
+        for (int k = 0; k < TRAJ_COLUMNS; k++) previous.values[k].assign(f.values[k].begin(), f.values[k].end());
+        return true;
+    }
+};
@@ -0,0 +1,183 @@
+#pragma once
+#include "narrowphase.hpp"
+#include "springs.hpp"
+
+enum Solver {SOLVER_FORCES, SOLVER_XPBD, SOLVER_XPBD_JACOBI, SOLVER_COUNT};
+const char* const solver_names[] = {"forces", "xpbd", "xpbd jacobi"};
+
+// Extended position based dynamics: after the bodies have been moved to their predicted positions, springs and
+// contacts are solved as constraints directly on the positions and the velocities are taken from the distance moved.
+// A spring is the distance constraint |x_b - x_a| = rest_length with compliance 1/stiffness, so it has the same energy
+// as the explicit spring but stays stable at any stiffness and timestep; contacts are hard inequality constraints.
+// Contact corrections move x_old along with x, so pushing overlapping bodies apart does not turn into velocity (like
+// separate() for the force based solver); instead the velocities are corrected along every contact normal afterwards,
+// an approaching pair leaving with restitution times its approach speed.
+//
+// The Gauss-Seidel variant projects one constraint after the other. The Jacobi variant computes every correction
+// from the positions at the start of the iteration and adds them up per body through the CSR adjacency, so both loops
+// run in parallel without races. Each correction is scaled by relaxation over the number of constraints on the
+// busier of its two bodies, which keeps the sum of the corrections on a body from overshooting.
+struct Xpbd {
+    int iterations = 4;
+    float relaxation = 1.f; // Jacobi only
+    float restitution = 1.f;
+    std::vector<float> lambda; // accumulated multiplier per spring
+    // every broadphase pair of the step is a potential contact, pool pair k in first[k] .. first[k + 1]
+    std::vector<uint32_t> contact_a, contact_b;
+    uint32_t first[4] = {};
+    std::vector<float> normal_x, normal_y; // last contact normal, from b to a
+    std::vector<uint8_t> touched;
+    std::vector<float> vx_pre, vy_pre;
+    // Jacobi: corrections per constraint, springs first then contacts; end b moves by its inverse mass times corr,
+    // end a by minus that
+    Adjacency contacts;
+    std::vector<float> scale, corr_x, corr_y;
+
+    // one constraint correction; false when the constraint is inactive
+    static bool springCorrection(const Bodies& s, const Springs& springs, uint32_t i, float inv_dt2, float lambda,
+                                 float& dl, float& nx, float& ny) {
+        const uint32_t a = springs.a[i], b = springs.b[i];
+        const float w = s.inv_mass[a] + s.inv_mass[b];
+        if (springs.stiffness[i] <= 0 || w == 0 || s.flags[a] & s.flags[b] & SLEEPING) return false;
+        const float compliance = inv_dt2/springs.stiffness[i];
+        const float dx = s.x[b] - s.x[a], dy = s.y[b] - s.y[a], distance = sqrt(dx*dx + dy*dy);
+        if (distance < 1e-6f) return false;
+        nx = dx/distance; ny = dy/distance;
+        dl = (springs.rest_length[i] - distance - compliance*lambda)/(w + compliance);
+        return true;
+    }
+    template <int A, int B> static bool contactCorrection(const Bodies& s, uint32_t a, uint32_t b, float& dl, float& nx, float& ny) {
+        const float w = s.inv_mass[a] + s.inv_mass[b];
+        float depth;
+        if (w == 0 || !PairContact<A, B>::find(s, a, b, nx, ny, depth)) return false;
+        dl = depth/w;
+        return true;
+    }
+
+    void solve(Bodies& s, Springs& springs, const std::vector<BodyPair> pool_pairs[3], float dt, bool jacobi, ThreadPool& pool) {
+        const float inv_dt2 = 1/(dt*dt);
+        lambda.assign(springs.size(), 0);
+        contact_a.clear(); contact_b.clear();
+        for (int k = 0; k < 3; k++) {
+            first[k] = contact_a.size();
+            for (uint32_t i = 0; i < pool_pairs[k].size(); i++) {contact_a.push_back(pool_pairs[k][i].a); contact_b.push_back(pool_pairs[k][i].b);}
+        }
+        first[3] = contact_a.size();
+        normal_x.resize(first[3]); normal_y.resize(first[3]); touched.assign(first[3], 0);
+
+        if (jacobi) {
+            prepareJacobi(s, springs);
+            for (int i = 0; i < iterations; i++) jacobiIteration(s, springs, inv_dt2, pool);
+        } else {
+            for (int i = 0; i < iterations; i++) {
+                for (uint32_t k = 0; k < springs.size(); k++) {
+                    float dl, nx, ny;
+                    if (!springCorrection(s, springs, k, inv_dt2, lambda[k], dl, nx, ny)) continue;
+                    lambda[k] += dl;
+                    const uint32_t a = springs.a[k], b = springs.b[k];
+                    s.x[a] -= s.inv_mass[a]*dl*nx; s.y[a] -= s.inv_mass[a]*dl*ny;
+                    s.x[b] += s.inv_mass[b]*dl*nx; s.y[b] += s.inv_mass[b]*dl*ny;
+                }
+                projectContacts<CIRCLE, CIRCLE>(s, first[0], first[1]);
+                projectContacts<CIRCLE, BOX>(s, first[1], first[2]);
+                projectContacts<BOX, BOX>(s, first[2], first[3]);
+            }
+        }
+        updateVelocities(s, dt, pool);
+    }
+
+    template <int A, int B> void projectContacts(Bodies& s, uint32_t begin, uint32_t end) {
+        for (uint32_t c = begin; c < end; c++) {
+            const uint32_t a = contact_a[c], b = contact_b[c];
+            float dl, nx, ny;
+            if (!contactCorrection<A, B>(s, a, b, dl, nx, ny)) continue;
+            const float ax = s.inv_mass[a]*dl*nx, ay = s.inv_mass[a]*dl*ny, bx = s.inv_mass[b]*dl*nx, by = s.inv_mass[b]*dl*ny;
+            s.x[a] += ax; s.y[a] += ay; s.x_old[a] += ax; s.y_old[a] += ay;
+            s.x[b] -= bx; s.y[b] -= by; s.x_old[b] -= bx; s.y_old[b] -= by;
+            normal_x[c] = nx; normal_y[c] = ny; touched[c] = 1;
+        }
+    }
+
+    void prepareJacobi(const Bodies& s, Springs& springs) {
+        const uint32_t n = s.size(), ns = springs.size(), nc = contact_a.size();
+        if (!springs.adjacencyValid(n)) springs.buildAdjacency(n);
+        contacts.build(contact_a.data(), contact_b.data(), nc, n);
+        const Adjacency& sa = springs.adjacency;
+        auto degree = [&](uint32_t i) {return std::max(1u, sa.degree(i) + contacts.degree(i));};
+        scale.resize(ns + nc); corr_x.resize(ns + nc); corr_y.resize(ns + nc);
+        for (uint32_t i = 0; i < ns; i++) scale[i] = relaxation/std::max(degree(springs.a[i]), degree(springs.b[i]));
+        for (uint32_t i = 0; i < nc; i++) scale[ns + i] = relaxation/std::max(degree(contact_a[i]), degree(contact_b[i]));
+    }
+
+    template <int A, int B> void contactCorrections(const Bodies& s, uint32_t begin, uint32_t end, uint32_t offset, ThreadPool& pool) {
+        pool.parallelFor(end - begin, 4096, [&](uint32_t from, uint32_t to) {
+            for (uint32_t c = begin + from; c < begin + to; c++) {
+                float dl, nx, ny;
+                if (!contactCorrection<A, B>(s, contact_a[c], contact_b[c], dl, nx, ny)) {corr_x[offset + c] = corr_y[offset + c] = 0; continue;}
+                dl *= scale[offset + c];
+                corr_x[offset + c] = -dl*nx; corr_y[offset + c] = -dl*ny;
+                normal_x[c] = nx; normal_y[c] = ny; touched[c] = 1;
+            }
+        });
+    }
+
+    void jacobiIteration(Bodies& s, const Springs& springs, float inv_dt2, ThreadPool& pool) {
+        const uint32_t ns = springs.size();
+        pool.parallelFor(ns, 4096, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                float dl, nx, ny;
+                if (!springCorrection(s, springs, i, inv_dt2, lambda[i], dl, nx, ny)) {corr_x[i] = corr_y[i] = 0; continue;}
+                dl *= scale[i];
+                lambda[i] += dl;
+                corr_x[i] = dl*nx; corr_y[i] = dl*ny;
+            }
+        });
+        contactCorrections<CIRCLE, CIRCLE>(s, first[0], first[1], ns, pool);
+        contactCorrections<CIRCLE, BOX>(s, first[1], first[2], ns, pool);
+        contactCorrections<BOX, BOX>(s, first[2], first[3], ns, pool);
+
+        const Adjacency& sa = springs.adjacency;
+        pool.parallelFor(s.size(), 4096, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                const float w = s.inv_mass[i];
+                if (w == 0) continue;
+                float sx = 0, sy = 0, cx = 0, cy = 0;
+                for (uint32_t e = sa.offsets[i]; e < sa.offsets[i + 1]; e++) {
+                    const uint32_t k = sa.ends[e] >> 1;
+                    const float sign = sa.ends[e] & 1 ? 1.f : -1.f;
+                    sx += sign*corr_x[k]; sy += sign*corr_y[k];
+                }
+                for (uint32_t e = contacts.offsets[i]; e < contacts.offsets[i + 1]; e++) {
+                    const uint32_t k = ns + (contacts.ends[e] >> 1);
+                    const float sign = contacts.ends[e] & 1 ? 1.f : -1.f;
+                    cx += sign*corr_x[k]; cy += sign*corr_y[k];
+                }
+                s.x[i] += w*(sx + cx); s.y[i] += w*(sy + cy);
+                s.x_old[i] += w*cx; s.y_old[i] += w*cy;
+            }
+        });
+    }
+
+    void updateVelocities(Bodies& s, float dt, ThreadPool& pool) {
+        const uint32_t n = s.size();
+        vx_pre.resize(n); vy_pre.resize(n);
+        pool.parallelFor(n, 8192, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                vx_pre[i] = s.vx[i]; vy_pre[i] = s.vy[i];
+                if (s.flags[i] & STATIC) continue;
+                s.vx[i] = (s.x[i] - s.x_old[i])/dt; s.vy[i] = (s.y[i] - s.y_old[i])/dt;
+            }
+        });
+        for (uint32_t c = 0; c < first[3]; c++) {
+            if (!touched[c]) continue;
+            const uint32_t a = contact_a[c], b = contact_b[c];
+            const float nx = normal_x[c], ny = normal_y[c], wa = s.inv_mass[a], wb = s.inv_mass[b];
+            const float before = (vx_pre[a] - vx_pre[b])*nx + (vy_pre[a] - vy_pre[b])*ny;
+            const float now = (s.vx[a] - s.vx[b])*nx + (s.vy[a] - s.vy[b])*ny;
+            const float target = before < 0 ? -restitution*before : before;
+            const float impulse = (target - now)/(wa + wb);
+            s.vx[a] += impulse*wa*nx; s.vy[a] += impulse*wa*ny;
+            s.vx[b] -= impulse*wb*nx; s.vy[b] -= impulse*wb*ny;
+        }
+    }
+};